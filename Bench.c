@@ -0,0 +1,337 @@
+#include "Main.h"
+
+#define BENCH_MAX_FILES 16
+
+// Summary of one benchmark file, times are wall clock milliseconds per position
+typedef struct {
+    char file[256];
+    unsigned long long positions;
+    unsigned long long errors;
+    unsigned long long timeouts;
+    double seconds;
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+    unsigned long long nodes;
+    double nodesPerSecond;
+    double hitRate;
+} BenchSummary;
+
+static int compareTimes(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile of sorted times
+static double percentile(double* times, unsigned long long count, int percent) {
+    if (count == 0)
+        return 0;
+
+    unsigned long long rank = (count * percent + 99) / 100;
+    return times[(rank > 0) ? rank - 1 : 0];
+}
+
+// set up the board from a test line, returns the index of the expected score
+static int readPosition(char* line, BoardState* board) {
+    int i;
+    initBoard(board);
+
+    for (i = 0; line[i] != ' ' && line[i] != '\0'; i++) {
+        playColumn(board, line[i] - '0' - 1);
+    }
+
+    return i + 1;
+}
+
+// play the reported move and solve the position it leads to, returns 1 if the move doesn't reach
+// the reported score (for a weak solve if it doesn't reach the same outcome)
+static int wrongMove(BoardState* board, HashTable* table, int weak, int found, int move) {
+    if (move < 0 || move >= WIDTH || !(generateMoves(board) & (MOVE_MASK << move)))
+        return 1;
+
+    BoardState child = *board;
+    SolveResult result;
+    int score;
+    playColumn(&child, move);
+    if (isAligned(&child))
+        score = MAX_STONES - countStones(child.position ^ child.mask);
+    else
+        score = -solvePosition(&child, table, weak, getThreadCount(), 0, &result);
+
+    if (weak)
+        return (score > 0) - (score < 0) != (found > 0) - (found < 0);
+    return score != found;
+}
+
+// solve every position of a test file, one "moves score" line per position
+static int benchFile(char* filename, HashTable* table, int weak, int clear, int checkMoves, double timeLimit, unsigned long long limit,
+                     FILE* csv, BenchSummary* summary, SearchStats* stats) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error opening file %s\n", filename);
+        return 1;
+    }
+
+    unsigned long long capacity = 1024;
+    double* times = malloc(capacity * sizeof(double));
+    unsigned long long probes = 0;
+    unsigned long long hits = 0;
+    char line[100];
+    BoardState board;
+    SolveResult result;
+
+    memset(summary, 0, sizeof(BenchSummary));
+    strncpy(summary->file, filename, sizeof(summary->file) - 1);
+
+    while (fgets(line, sizeof(line), file) && summary->positions < limit) {
+        int expectedStart = readPosition(line, &board);
+        int expected = atoi(line + expectedStart);
+
+        // keys are exact so the table is kept between positions unless each one should be timed cold
+        if (clear)
+            clearHashTable(table);
+
+        double start = getTime();
+        int found = solvePosition(&board, table, weak, getThreadCount(), timeLimit, &result);
+        double time = (getTime() - start) * 1000;
+
+        // a search that ran out of time is only wrong if its bounds exclude the expected score
+        int wrong;
+        if (!result.complete) {
+            summary->timeouts++;
+            int target = (weak) ? (expected > 0) - (expected < 0) : expected;
+            wrong = target < result.lower || target > result.upper;
+        }
+        else {
+            wrong = (!weak && expected != found) || (weak && expected * found < 0);
+        }
+
+        if (wrong) {
+            printf("\nError: %d %d\n", expected, found);
+            printBoard(&board, countStones(board.mask) & 1);
+            summary->errors++;
+        }
+        else if (checkMoves && result.complete && wrongMove(&board, table, weak, found, result.move)) {
+            printf("\nError: move %d doesn't reach %d\n", result.move, found);
+            printBoard(&board, countStones(board.mask) & 1);
+            summary->errors++;
+        }
+
+        if (summary->positions == capacity) {
+            capacity *= 2;
+            times = realloc(times, capacity * sizeof(double));
+        }
+        times[summary->positions++] = time;
+        summary->seconds += time / 1000;
+        summary->nodes += result.nodes;
+        probes += result.probes;
+        hits += result.hits;
+#if SEARCH_STATS
+        mergeStats(stats, &result.stats);
+#endif
+
+        if (csv != NULL) {
+            line[expectedStart - 1] = '\0';
+            fprintf(csv, "%s,%llu,%s,%d,%d,%.6f,%llu,%llu,%llu\n", filename, summary->positions, line,
+                    expected, found, time, result.nodes, result.probes, result.hits);
+        }
+    }
+    fclose(file);
+
+    qsort(times, summary->positions, sizeof(double), compareTimes);
+    summary->mean = (summary->positions) ? summary->seconds * 1000 / summary->positions : 0;
+    summary->p50 = percentile(times, summary->positions, 50);
+    summary->p95 = percentile(times, summary->positions, 95);
+    summary->p99 = percentile(times, summary->positions, 99);
+    summary->max = (summary->positions) ? times[summary->positions - 1] : 0;
+    summary->nodesPerSecond = (summary->seconds > 0) ? summary->nodes / summary->seconds : 0;
+    summary->hitRate = (probes) ? (double)hits / probes : 0;
+
+    free(times);
+    return 0;
+}
+
+static void printSummary(BenchSummary* summary) {
+    printf("%s: %llu positions, %llu errors, %llu timeouts, %.3f s\n", summary->file, summary->positions,
+           summary->errors, summary->timeouts, summary->seconds);
+    printf("  time per position (ms): mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+           summary->mean, summary->p50, summary->p95, summary->p99, summary->max);
+    printf("  nodes: %llu  nodes/s: %.0f  tt hit rate: %.1f%%\n",
+           summary->nodes, summary->nodesPerSecond, summary->hitRate * 100);
+}
+
+// one file per line so a saved report can be read back with the same format
+#define SUMMARY_FORMAT "    {\"file\": \"%s\", \"positions\": %llu, \"errors\": %llu, \"timeouts\": %llu, \"seconds\": %.6f, " \
+    "\"meanMs\": %.6f, \"p50Ms\": %.6f, \"p95Ms\": %.6f, \"p99Ms\": %.6f, \"maxMs\": %.6f, " \
+    "\"nodes\": %llu, \"nodesPerSecond\": %.1f, \"ttHitRate\": %.6f}"
+#define SUMMARY_SCAN " {\"file\": \"%255[^\"]\", \"positions\": %llu, \"errors\": %llu, \"timeouts\": %llu, \"seconds\": %lf, " \
+    "\"meanMs\": %lf, \"p50Ms\": %lf, \"p95Ms\": %lf, \"p99Ms\": %lf, \"maxMs\": %lf, " \
+    "\"nodes\": %llu, \"nodesPerSecond\": %lf, \"ttHitRate\": %lf}"
+// reports written before the timeout count was added
+#define OLD_SUMMARY_SCAN " {\"file\": \"%255[^\"]\", \"positions\": %llu, \"errors\": %llu, \"seconds\": %lf, " \
+    "\"meanMs\": %lf, \"p50Ms\": %lf, \"p95Ms\": %lf, \"p99Ms\": %lf, \"maxMs\": %lf, " \
+    "\"nodes\": %llu, \"nodesPerSecond\": %lf, \"ttHitRate\": %lf}"
+
+static int writeJson(char* path, BenchSummary* summaries, int count, int weak) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Error opening file %s\n", path);
+        return 1;
+    }
+
+    fprintf(file, "{\n  \"threads\": %d,\n  \"weak\": %d,\n  \"files\": [\n", getThreadCount(), weak);
+    for (int i = 0; i < count; i++) {
+        BenchSummary* s = &summaries[i];
+        fprintf(file, SUMMARY_FORMAT, s->file, s->positions, s->errors, s->timeouts, s->seconds, s->mean, s->p50,
+                s->p95, s->p99, s->max, s->nodes, s->nodesPerSecond, s->hitRate);
+        fprintf(file, (i < count - 1) ? ",\n" : "\n");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return 0;
+}
+
+static void printChange(char* name, double now, double before) {
+    if (before > 0)
+        printf("  %s: %.6g -> %.6g (%+.1f%%)\n", name, before, now, (now - before) / before * 100);
+}
+
+// compare the summaries against a report written by an earlier run
+static int compareBaseline(char* path, BenchSummary* summaries, int count) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Error opening file %s\n", path);
+        return 1;
+    }
+
+    char line[1024];
+    BenchSummary base;
+    while (fgets(line, sizeof(line), file)) {
+        // a baseline from before the timeout count had none
+        base.timeouts = 0;
+        if (sscanf(line, SUMMARY_SCAN, base.file, &base.positions, &base.errors, &base.timeouts, &base.seconds, &base.mean,
+                   &base.p50, &base.p95, &base.p99, &base.max, &base.nodes, &base.nodesPerSecond, &base.hitRate) != 13
+            && sscanf(line, OLD_SUMMARY_SCAN, base.file, &base.positions, &base.errors, &base.seconds, &base.mean,
+                      &base.p50, &base.p95, &base.p99, &base.max, &base.nodes, &base.nodesPerSecond, &base.hitRate) != 12)
+            continue;
+
+        for (int i = 0; i < count; i++) {
+            BenchSummary* s = &summaries[i];
+            if (strcmp(s->file, base.file) != 0)
+                continue;
+
+            printf("%s vs baseline:\n", s->file);
+            if (s->positions != base.positions)
+                printf("  warning: %llu positions, baseline has %llu\n", s->positions, base.positions);
+            if (s->timeouts != base.timeouts)
+                printf("  timeouts: %llu -> %llu\n", base.timeouts, s->timeouts);
+            printChange("mean ms", s->mean, base.mean);
+            printChange("p50 ms", s->p50, base.p50);
+            printChange("p95 ms", s->p95, base.p95);
+            printChange("p99 ms", s->p99, base.p99);
+            printChange("max ms", s->max, base.max);
+            printChange("nodes", s->nodes, base.nodes);
+            printChange("nodes/s", s->nodesPerSecond, base.nodesPerSecond);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// run the benchmark tests
+// options: -weak, -clear (empty the table before each position), -moves (check that the reported move reaches the score), -time <seconds per position>, -limit <positions per file>, -json <report>,
+// -csv <per position rows>, -baseline <report>, -stats <search statistics of every file as JSON, needs SEARCH_STATS>
+int benchmark(int argc, char* argv[]) {
+    int weak = 0;
+    int clear = 0;
+    int checkMoves = 0;
+    double timeLimit = 0;
+    unsigned long long limit = ~0ull;
+    char* jsonPath = NULL;
+    char* csvPath = NULL;
+    char* baselinePath = NULL;
+    char* statsPath = NULL;
+    char* files[BENCH_MAX_FILES];
+    int fileCount = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-weak") == 0)
+            weak = 1;
+        else if (strcmp(argv[i], "-clear") == 0)
+            clear = 1;
+        else if (strcmp(argv[i], "-moves") == 0)
+            checkMoves = 1;
+        else if (strcmp(argv[i], "-time") == 0 && i + 1 < argc)
+            timeLimit = atof(argv[++i]);
+        else if (strcmp(argv[i], "-limit") == 0 && i + 1 < argc)
+            limit = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+            csvPath = argv[++i];
+        else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc)
+            statsPath = argv[++i];
+        else if (fileCount < BENCH_MAX_FILES)
+            files[fileCount++] = argv[i];
+    }
+
+    if (fileCount == 0) {
+        printf("No benchmark files given\n");
+        return 1;
+    }
+
+    FILE* csv = NULL;
+    if (csvPath != NULL) {
+        csv = fopen(csvPath, "w");
+        if (csv == NULL) {
+            printf("Error opening file %s\n", csvPath);
+            return 1;
+        }
+        fprintf(csv, "file,index,moves,expected,found,ms,nodes,probes,hits\n");
+    }
+
+    HashTable* table = initHashTable();
+    BenchSummary summaries[BENCH_MAX_FILES];
+    SearchStats stats;
+    memset(&stats, 0, sizeof(SearchStats));
+    int count = 0;
+    int errors = 0;
+
+    for (int i = 0; i < fileCount; i++) {
+        if (benchFile(files[i], table, weak, clear, checkMoves, timeLimit, limit, csv, &summaries[count], &stats) != 0) {
+            errors++;
+            continue;
+        }
+        printSummary(&summaries[count]);
+        errors += summaries[count].errors > 0;
+        count++;
+    }
+
+    freeHashTable(table);
+    if (csv != NULL)
+        fclose(csv);
+
+    if (jsonPath != NULL)
+        writeJson(jsonPath, summaries, count, weak);
+    if (baselinePath != NULL)
+        compareBaseline(baselinePath, summaries, count);
+
+    if (statsPath != NULL) {
+        FILE* file = fopen(statsPath, "w");
+        if (file == NULL) {
+            printf("Error opening file %s\n", statsPath);
+        }
+        else {
+            writeStatsJson(file, &stats);
+            fclose(file);
+        }
+    }
+
+    return errors != 0;
+}
@@ -0,0 +1,57 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Board geometry, the standard board is 7 wide and 6 high. Other sizes are separate builds
+// (-DWIDTH=8 -DHEIGHT=7 or make board WIDTH=8 HEIGHT=7) and every mask below is a constant of
+// the build, so each size compiles to the same straight line code as the standard board.
+// Each row of the bitboard has a spare bit above its last column and the position keys use
+// one row above the board, so a board needs (WIDTH + 1) * (HEIGHT + 1) bits. Boards that
+// don't fit in 64 bits use 128-bit bitboards
+#ifndef WIDTH
+#define WIDTH 7
+#endif
+#ifndef HEIGHT
+#define HEIGHT 6
+#endif
+
+#if WIDTH < 4 || HEIGHT < 4 || WIDTH > 9
+#error "boards need 4 to 9 columns and at least 4 rows"
+#endif
+#if (WIDTH + 1) * (HEIGHT + 1) > 128
+#error "board does not fit in 128 bits"
+#endif
+
+#if (WIDTH + 1) * (HEIGHT + 1) > 64
+#define BITBOARD_128
+typedef unsigned __int128 bitboard;
+#else
+typedef unsigned long long bitboard;
+#endif
+
+#define MAX_STONES ((WIDTH * HEIGHT + 1) / 2 + 1) // one more than the stones of the first player on a full board
+#define BOTTOM_MASK (((bitboard)1 << WIDTH) - 1)
+#define MOVE_MASK ((((bitboard)1 << (HEIGHT * (WIDTH + 1))) - 1) / (((bitboard)1 << (WIDTH + 1)) - 1)) // first column
+#define BOARD_MASK (MOVE_MASK * BOTTOM_MASK)
+#define TOP_MASK (BOTTOM_MASK << ((HEIGHT - 1) * (WIDTH + 1)))
+#define KEY_COLUMN_MASK (MOVE_MASK | ((bitboard)1 << (HEIGHT * (WIDTH + 1)))) // first column and the key row above it
+#define BOOK_FITS (HEIGHT * (WIDTH + 1) <= 48) // books store positions in 48 bits
+
+static inline int countStones(bitboard stones) {
+#ifdef BITBOARD_128
+    return __builtin_popcountll((unsigned long long)stones) + __builtin_popcountll((unsigned long long)(stones >> 64));
+#else
+    return __builtin_popcountll(stones);
+#endif
+}
+
+// index of the lowest set bit, stones can't be 0
+static inline int lowestBit(bitboard stones) {
+#ifdef BITBOARD_128
+    unsigned long long low = (unsigned long long)stones;
+    return (low) ? __builtin_ctzll(low) : 64 + __builtin_ctzll((unsigned long long)(stones >> 64));
+#else
+    return __builtin_ctzll(stones);
+#endif
+}
+
+#endif // BOARD_H
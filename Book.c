@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Main.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// a position and its mirror image are stored once, under whichever of the two sorts first
+static int mirrorPosition(unsigned long long* p1, unsigned long long* p2) {
+    unsigned long long mirror1 = mirrorBoard(*p1 & BOOK_POSITION_MASK);
+    unsigned long long mirror2 = mirrorBoard(*p2 & BOOK_POSITION_MASK);
+
+    if (mirror1 < (*p1 & BOOK_POSITION_MASK) || (mirror1 == (*p1 & BOOK_POSITION_MASK) && mirror2 < (*p2 & BOOK_POSITION_MASK))) {
+        *p1 = mirror1;
+        *p2 = mirror2;
+        return 1;
+    }
+    return 0;
+}
+
+BookRecord makeBookRecord(unsigned long long p1, unsigned long long p2, int move, int eval) {
+    BookRecord record;
+    if (mirrorPosition(&p1, &p2) && move >= 0)
+        move = WIDTH - 1 - move;
+
+    record.p1 = p1 & BOOK_POSITION_MASK;
+    record.p2 = (p2 & BOOK_POSITION_MASK)
+              | (unsigned long long)(unsigned char)move << 48
+              | (unsigned long long)(unsigned char)eval << 56;
+    return record;
+}
+
+static int compareRecords(const void* a, const void* b) {
+    const BookRecord* x = (const BookRecord*)a;
+    const BookRecord* y = (const BookRecord*)b;
+    unsigned long long xp2 = x->p2 & BOOK_POSITION_MASK;
+    unsigned long long yp2 = y->p2 & BOOK_POSITION_MASK;
+
+    if (x->p1 != y->p1)
+        return (x->p1 < y->p1) ? -1 : 1;
+    if (xp2 != yp2)
+        return (xp2 < yp2) ? -1 : 1;
+    return 0;
+}
+
+// a record with its line number so duplicates keep the first line of the file
+typedef struct {
+    BookRecord record;
+    unsigned long long line;
+} TextRecord;
+
+static int compareTextRecords(const void* a, const void* b) {
+    const TextRecord* x = (const TextRecord*)a;
+    const TextRecord* y = (const TextRecord*)b;
+    int cmp = compareRecords(&x->record, &y->record);
+
+    if (cmp != 0)
+        return cmp;
+    return (x->line < y->line) ? -1 : (x->line > y->line);
+}
+
+// parse a text book (one "p1 p2 move eval" line per position) into a sorted array without duplicates
+static BookRecord* readTextBook(const char* path, unsigned long long* count) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    unsigned long long capacity = 1024;
+    unsigned long long size = 0;
+    TextRecord* lines = malloc(capacity * sizeof(TextRecord));
+
+    char line[100];
+    unsigned long long p1;
+    unsigned long long p2;
+    int move;
+    int eval;
+
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%llu %llu %d %d", &p1, &p2, &move, &eval) != 4)
+            continue;
+
+        if (size == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(TextRecord));
+        }
+        lines[size].record = makeBookRecord(p1, p2, move, eval);
+        lines[size].line = size;
+        size++;
+    }
+    fclose(file);
+
+    qsort(lines, size, sizeof(TextRecord), compareTextRecords);
+
+    // the recursive book builder writes transposed positions more than once
+    BookRecord* records = malloc((size ? size : 1) * sizeof(BookRecord));
+    unsigned long long unique = 0;
+    for (unsigned long long i = 0; i < size; i++) {
+        if (unique == 0 || compareRecords(&records[unique - 1], &lines[i].record) != 0)
+            records[unique++] = lines[i].record;
+    }
+    free(lines);
+
+    *count = unique;
+    return records;
+}
+
+// map a whole file read only, returns NULL on failure
+void* mapFile(const char* path, size_t* length) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    *length = (size_t)size.QuadPart;
+    return base;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    *length = st.st_size;
+    return base;
+#endif
+}
+
+void unmapFile(void* base, size_t length) {
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+#else
+    munmap(base, length);
+#endif
+}
+
+// open a compiled book by mapping it, text books are parsed into memory once instead.
+// Returns NULL with the reason in error if the book can't be used
+Book* openBook(const char* path, int* error) {
+    *error = BOOK_OPEN_ERROR;
+
+    // positions of larger boards don't fit in a record
+    if (!BOOK_FITS)
+        return NULL;
+
+    Book* book = malloc(sizeof(Book));
+    size_t length = 0;
+    void* base = mapFile(path, &length);
+
+    // books written before the current format are rebuilt rather than read as text
+    if (base != NULL && length >= sizeof(BookHeader) && memcmp(base, BOOK_MAGIC, 6) == 0 && memcmp(base, BOOK_MAGIC, 8) != 0) {
+        *error = BOOK_OLD_FORMAT;
+        unmapFile(base, length);
+        free(book);
+        return NULL;
+    }
+
+    // records of another board size are other positions
+    const BookHeader* header = (const BookHeader*)base;
+    if (base != NULL && length >= sizeof(BookHeader) && memcmp(base, BOOK_MAGIC, 8) == 0
+        && (header->width != WIDTH || header->height != HEIGHT)) {
+        *error = BOOK_SIZE_ERROR;
+        unmapFile(base, length);
+        free(book);
+        return NULL;
+    }
+
+    if (base != NULL && length >= sizeof(BookHeader) && memcmp(base, BOOK_MAGIC, 8) == 0) {
+        if (sizeof(BookHeader) + header->count * sizeof(BookRecord) <= length) {
+            book->records = (const BookRecord*)((const char*)base + sizeof(BookHeader));
+            book->count = header->count;
+            book->base = base;
+            book->length = length;
+            book->mapped = 1;
+            book->exact = header->exact != 0;
+            *error = BOOK_OK;
+            return book;
+        }
+    }
+
+    if (base != NULL)
+        unmapFile(base, length);
+
+    unsigned long long count = 0;
+    BookRecord* records = readTextBook(path, &count);
+    if (records == NULL) {
+        free(book);
+        return NULL;
+    }
+
+    book->records = records;
+    book->count = count;
+    book->base = records;
+    book->length = count * sizeof(BookRecord);
+    book->mapped = 0;
+    book->exact = 0;
+    *error = BOOK_OK;
+    return book;
+}
+
+const char* bookError(int error) {
+    switch (error) {
+    case BOOK_OK:
+        return "ok";
+    case BOOK_OPEN_ERROR:
+        return "can't be read";
+    case BOOK_OLD_FORMAT:
+        return "uses an old format, convert it again";
+    case BOOK_SIZE_ERROR:
+        return "is for another board size";
+    }
+    return "unknown error";
+}
+
+void closeBook(Book* book) {
+    if (book->mapped)
+        unmapFile(book->base, book->length);
+    else
+        free(book->base);
+    free(book);
+}
+
+// binary search the book for the position or its mirror image, returns 0 if it is not in the book
+// the move is mirrored back if the book holds the mirror image
+int probeBook(const Book* book, unsigned long long p1, unsigned long long p2, int* move, int* eval) {
+    int mirrored = mirrorPosition(&p1, &p2);
+    BookRecord key = makeBookRecord(p1, p2, 0, 0);
+    unsigned long long low = 0;
+    unsigned long long high = book->count;
+
+    while (low < high) {
+        unsigned long long mid = low + (high - low) / 2;
+        const BookRecord* record = &book->records[mid];
+        int cmp = compareRecords(record, &key);
+
+        if (cmp == 0) {
+            *move = BOOK_RECORD_MOVE(record);
+            *eval = BOOK_RECORD_EVAL(record);
+            if (mirrored && *move < WIDTH)
+                *move = WIDTH - 1 - *move;
+            return 1;
+        }
+        else if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return 0;
+}
+
+// look up a position by the stones of the player who moved first and those of the other player. With as
+// many stones each a position and its color swapped twin are both in the book, so only the
+// orientation the book was built with is probed
+int probeBookStones(const Book* book, unsigned long long first, unsigned long long second, int* move, int* eval) {
+    if (BOOK_PLAYER)
+        return probeBook(book, second, first, move, eval);
+    return probeBook(book, first, second, move, eval);
+}
+
+// read a log of records appended one at a time (a book build checkpoint) into a sorted book in memory,
+// a record cut short by a crash is ignored. Returns NULL if the file can't be read
+Book* openBookLog(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    unsigned long long capacity = 1024;
+    unsigned long long count = 0;
+    BookRecord* records = malloc(capacity * sizeof(BookRecord));
+    size_t read;
+
+    while ((read = fread(&records[count], sizeof(BookRecord), capacity - count, file)) > 0) {
+        count += read;
+        if (count == capacity) {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(BookRecord));
+        }
+    }
+    fclose(file);
+
+    qsort(records, count, sizeof(BookRecord), compareRecords);
+    unsigned long long unique = 0;
+    for (unsigned long long i = 0; i < count; i++) {
+        if (unique == 0 || compareRecords(&records[unique - 1], &records[i]) != 0)
+            records[unique++] = records[i];
+    }
+
+    Book* book = malloc(sizeof(Book));
+    book->records = records;
+    book->count = unique;
+    book->base = records;
+    book->length = unique * sizeof(BookRecord);
+    book->mapped = 0;
+    book->exact = 0;
+    return book;
+}
+
+// sort the records and write them as a compiled book, the records are reordered in place.
+// exact is 0 if the evals are only right in sign
+int writeBook(const char* path, BookRecord* records, unsigned long long count, int exact) {
+    if (!BOOK_FITS) {
+        printf("Books need a board of at most 48 bits\n");
+        return 1;
+    }
+
+    qsort(records, count, sizeof(BookRecord), compareRecords);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Error opening file\n");
+        return 1;
+    }
+
+    // drop duplicate positions while writing through the stdio buffer
+    unsigned long long unique = 0;
+    BookHeader header;
+    memset(&header, 0, sizeof(BookHeader));
+    memcpy(header.magic, BOOK_MAGIC, 8);
+    header.exact = exact;
+    header.width = WIDTH;
+    header.height = HEIGHT;
+    fwrite(&header, sizeof(BookHeader), 1, file);
+
+    for (unsigned long long i = 0; i < count; i++) {
+        if (i > 0 && compareRecords(&records[i - 1], &records[i]) == 0)
+            continue;
+        fwrite(&records[i], sizeof(BookRecord), 1, file);
+        unique++;
+    }
+
+    header.count = unique;
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(BookHeader), 1, file);
+    fclose(file);
+
+    printf("Book positions: %llu\n", unique);
+    return 0;
+}
+
+// compile a text book into the sorted binary format, a text book doesn't say how its
+// evals were solved so the compiled book only vouches for their sign
+int convertBook(const char* textPath, const char* binaryPath) {
+    unsigned long long count = 0;
+    BookRecord* records = readTextBook(textPath, &count);
+    if (records == NULL) {
+        printf("Error opening file\n");
+        return 1;
+    }
+
+    int result = writeBook(binaryPath, records, count, 0);
+    free(records);
+    return result;
+}
@@ -0,0 +1,57 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stdlib.h>
+
+#define BOOK_MAGIC "C4BOOK\0\4" // version 2 stores mirror images once, 3 says if the evals are exact, 4 gives the board size
+#define BOOK_POSITION_MASK 0xffffffffffffull
+#define BOOK_PLAYER 1 // the player moving first in the book, records keep their stones in p2
+
+// errors of openBook
+#define BOOK_OK 0
+#define BOOK_OPEN_ERROR 1 // the file could not be read
+#define BOOK_OLD_FORMAT 2 // a compiled book of an earlier version
+#define BOOK_SIZE_ERROR 3 // a compiled book of another board size
+
+// A book record, the position is stored in the low 48 bits of p1 and p2
+// and the move and eval are packed into the unused top bits of p2
+typedef struct {
+    unsigned long long p1;
+    unsigned long long p2;
+} BookRecord;
+
+// Header of a compiled book file, followed by count records sorted by position
+typedef struct {
+    char magic[8];
+    unsigned long long count;
+    unsigned long long exact; // 1 if the evals are exact scores, 0 if only their sign is known
+    unsigned int width;
+    unsigned int height;
+} BookHeader;
+
+// An opening book, either a memory-mapped compiled book or a text book loaded into memory
+typedef struct {
+    const BookRecord* records;
+    unsigned long long count;
+    void* base;
+    size_t length;
+    int mapped;
+    int exact; // text books and checkpoints don't say, their evals are taken as signs only
+} Book;
+
+#define BOOK_RECORD_MOVE(record) ((int)(((record)->p2 >> 48) & 0xff))
+#define BOOK_RECORD_EVAL(record) ((int)(signed char)(((record)->p2 >> 56) & 0xff))
+
+BookRecord makeBookRecord(unsigned long long p1, unsigned long long p2, int move, int eval);
+Book* openBook(const char* path, int* error);
+const char* bookError(int error);
+Book* openBookLog(const char* path);
+void closeBook(Book* book);
+int probeBook(const Book* book, unsigned long long p1, unsigned long long p2, int* move, int* eval);
+int probeBookStones(const Book* book, unsigned long long first, unsigned long long second, int* move, int* eval);
+int writeBook(const char* path, BookRecord* records, unsigned long long count, int exact);
+int convertBook(const char* textPath, const char* binaryPath);
+void* mapFile(const char* path, size_t* length);
+void unmapFile(void* base, size_t length);
+
+#endif // BOOK_H
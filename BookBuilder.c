@@ -0,0 +1,515 @@
+#include "Main.h"
+
+#define WEAK_BOOK 0
+#define BOOK_SPLIT_PLY 4 // default ply of the frontier positions a sharded build is split at
+#define BOOK_MAX_KNOWN 16 // books given with -known
+
+// A position in the book tree, stored from the point of view of the player to move
+// so a position and its color swapped twin are the same node. Mirror images are
+// also one node, stored as whichever of the two sorts first
+typedef struct {
+    bitboard mine;
+    bitboard theirs;
+    int eval;
+    unsigned int frontier; // the first frontier position above the node, a sharded build keys the leaves by it
+    char move;
+    char leaf;
+    char known; // the eval and move are set
+} BookNode;
+
+// The leaves of the tree are solved by a pool of workers sharing one table, every solve
+// is appended to the checkpoint as it finishes so an interrupted build can carry on from there
+typedef struct {
+    BookNode** leaves;
+    unsigned long long count;
+    unsigned long long next;
+    unsigned long long done;
+    HashTable* table;
+    FILE* log;
+    pthread_mutex_t lock;
+    int error;
+} BookWork;
+
+static int compareNodes(const void* a, const void* b) {
+    const BookNode* x = (const BookNode*)a;
+    const BookNode* y = (const BookNode*)b;
+
+    if (x->mine != y->mine)
+        return (x->mine < y->mine) ? -1 : 1;
+    if (x->theirs != y->theirs)
+        return (x->theirs < y->theirs) ? -1 : 1;
+    return 0;
+}
+
+static void mirrorNode(bitboard* mine, bitboard* theirs) {
+    bitboard mirrorMine = mirrorBoard(*mine);
+    bitboard mirrorTheirs = mirrorBoard(*theirs);
+
+    if (mirrorMine < *mine || (mirrorMine == *mine && mirrorTheirs < *theirs)) {
+        *mine = mirrorMine;
+        *theirs = mirrorTheirs;
+    }
+}
+
+static BookNode* findNode(BookNode* level, unsigned long long count, bitboard mine, bitboard theirs) {
+    mirrorNode(&mine, &theirs);
+    BookNode key;
+    memset(&key, 0, sizeof(BookNode));
+    key.mine = mine;
+    key.theirs = theirs;
+    return bsearch(&key, level, count, sizeof(BookNode), compareNodes);
+}
+
+// the non losing moves of the node in the order the solver would explore them
+static int orderMoves(BookNode* node, bitboard* moves, char order[]) {
+    BoardState board;
+    setBoard(&board, node->mine, node->theirs, 0);
+
+    centerOrder(order);
+    *moves = getNonLosingMove(&board, generateMoves(&board));
+    return sortMoves(&board, *moves, order, NULL);
+}
+
+// a node is solved directly instead of expanded if the game ends within a move
+static int isTerminal(BookNode* node) {
+    BoardState board;
+    setBoard(&board, node->mine, node->theirs, 0);
+    bitboard moves = generateMoves(&board);
+
+    if (!moves || computeWinningPosition(node->mine, node->mine | node->theirs) & moves)
+        return 1;
+    return !getNonLosingMove(&board, moves);
+}
+
+// the player to move at a ply of the book
+static int plyPlayer(int ply) {
+    return (ply & 1) ? !BOOK_PLAYER : BOOK_PLAYER;
+}
+
+// the book stores the stones by player rather than by who is to move
+static void nodeStones(BookNode* node, int ply, bitboard* p1, bitboard* p2) {
+    int player = plyPlayer(ply);
+    *p1 = (player) ? node->theirs : node->mine;
+    *p2 = (player) ? node->mine : node->theirs;
+}
+
+// a book built from other books is only exact if all of them are
+static int booksExact(Book** books, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!books[i]->exact)
+            return 0;
+    }
+    return 1;
+}
+
+// take the value of the node from the first book that has it
+static int lookupNode(Book** books, int count, BookNode* node, int ply) {
+    bitboard p1, p2;
+    int move;
+    int eval;
+    nodeStones(node, ply, &p1, &p2);
+
+    for (int i = 0; i < count; i++) {
+        if (probeBook(books[i], p1, p2, &move, &eval)) {
+            node->move = move;
+            node->eval = eval;
+            node->known = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// expand every inner node of a level into the sorted, unique positions of the next level
+static BookNode* expandLevel(BookNode* level, unsigned long long count, unsigned long long* nextCount) {
+    unsigned long long capacity = count * WIDTH + 1;
+    unsigned long long size = 0;
+    BookNode* next = malloc(capacity * sizeof(BookNode));
+
+    for (unsigned long long i = 0; i < count; i++) {
+        if (level[i].leaf)
+            continue;
+
+        bitboard moves;
+        char order[WIDTH];
+        int moveCount = orderMoves(&level[i], &moves, order);
+
+        for (int j = 0; j < moveCount; j++) {
+            bitboard move = moves & (MOVE_MASK << order[j]);
+            BookNode* child = &next[size++];
+            child->mine = level[i].theirs;
+            child->theirs = level[i].mine | move;
+            mirrorNode(&child->mine, &child->theirs);
+            child->eval = 0;
+            child->frontier = level[i].frontier;
+            child->move = -1;
+            child->leaf = 0;
+            child->known = 0;
+        }
+    }
+
+    // transposed and mirrored positions are only solved once, under the first frontier position above them
+    qsort(next, size, sizeof(BookNode), compareNodes);
+    unsigned long long unique = 0;
+    for (unsigned long long i = 0; i < size; i++) {
+        if (unique > 0 && compareNodes(&next[unique - 1], &next[i]) == 0) {
+            if (next[i].frontier < next[unique - 1].frontier)
+                next[unique - 1].frontier = next[i].frontier;
+        }
+        else {
+            next[unique++] = next[i];
+        }
+    }
+
+    *nextCount = unique;
+    return next;
+}
+
+// enumerate the unique positions of every ply up to depth, returns the number of leaves. The positions
+// at the split ply are the frontier, numbered in order, the same for every depth from the split ply on
+static unsigned long long enumerateTree(int depth, int split, BookNode** levels, unsigned long long* counts) {
+    levels[0] = calloc(1, sizeof(BookNode));
+    levels[0]->move = -1;
+    counts[0] = 1;
+
+    unsigned long long leafCount = 0;
+    for (int d = 0; d <= depth; d++) {
+        for (unsigned long long i = 0; i < counts[d]; i++) {
+            if (d == split)
+                levels[d][i].frontier = (unsigned int)i;
+            levels[d][i].leaf = (d == depth) || isTerminal(&levels[d][i]);
+            leafCount += levels[d][i].leaf;
+        }
+        printf("Depth %d: %llu positions\n", d, counts[d]);
+
+        if (d < depth)
+            levels[d + 1] = expandLevel(levels[d], counts[d], &counts[d + 1]);
+    }
+
+    return leafCount;
+}
+
+static void freeTree(BookNode** levels, unsigned long long* counts, int depth) {
+    for (int d = 0; d <= depth; d++) {
+        free(levels[d]);
+    }
+    free(levels);
+    free(counts);
+}
+
+// back propagate the values of the children, keeping the first move in search order on ties. An inner
+// node with a child that isn't known keeps the value a book gave it, returns the positions left unknown
+static unsigned long long propagateValues(BookNode** levels, unsigned long long* counts, int depth) {
+    unsigned long long unknown = 0;
+
+    for (int d = depth; d >= 0; d--) {
+        for (unsigned long long i = 0; i < counts[d]; i++) {
+            BookNode* node = &levels[d][i];
+            if (!node->leaf) {
+                bitboard moves;
+                char order[WIDTH];
+                int moveCount = orderMoves(node, &moves, order);
+                int eval = -100;
+                int best = -1;
+                int complete = 1;
+
+                for (int j = 0; j < moveCount && complete; j++) {
+                    bitboard move = moves & (MOVE_MASK << order[j]);
+                    BookNode* child = findNode(levels[d + 1], counts[d + 1], node->theirs, node->mine | move);
+                    complete = child->known;
+                    if (complete && -child->eval > eval) {
+                        eval = -child->eval;
+                        best = order[j];
+                    }
+                }
+
+                if (complete) {
+                    node->eval = eval;
+                    node->move = best;
+                    node->known = 1;
+                }
+            }
+            unknown += !node->known;
+        }
+    }
+
+    return unknown;
+}
+
+// write the known positions as a compiled book, with shards only the leaves of one shard
+static int writeTree(char* path, BookNode** levels, unsigned long long* counts, int depth, int shard, int shards, int exact) {
+    unsigned long long total = 0;
+    for (int d = 0; d <= depth; d++) {
+        total += counts[d];
+    }
+
+    BookRecord* records = malloc(sizeof(BookRecord) * total);
+    unsigned long long count = 0;
+    for (int d = 0; d <= depth; d++) {
+        for (unsigned long long i = 0; i < counts[d]; i++) {
+            BookNode* node = &levels[d][i];
+            if (!node->known || (shards > 1 && (!node->leaf || node->frontier % shards != (unsigned int)shard)))
+                continue;
+
+            bitboard p1, p2;
+            nodeStones(node, d, &p1, &p2);
+            records[count++] = makeBookRecord(p1, p2, node->move, node->eval);
+        }
+    }
+
+    int result = writeBook(path, records, count, exact);
+    free(records);
+    return result;
+}
+
+static void* bookWorker(void* arg) {
+    BookWork* work = (BookWork*)arg;
+    BoardState board;
+    SolveResult result;
+
+    while (1) {
+        unsigned long long i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (i >= work->count)
+            break;
+
+        BookNode* node = work->leaves[i];
+        setBoard(&board, node->mine, node->theirs, 0);
+        node->eval = solvePosition(&board, work->table, WEAK_BOOK, 1, 0, &result);
+        node->move = result.move;
+        node->known = 1;
+
+        // the root entry can be replaced by another worker, fall back to the first move the solver would try
+        if (node->move == -1) {
+            bitboard moves;
+            char order[WIDTH];
+            orderMoves(node, &moves, order);
+            node->move = order[0];
+        }
+
+        // the checkpoint holds the leaves by who is to move, as the nodes are
+        BookRecord record = makeBookRecord(node->mine, node->theirs, node->move, node->eval);
+        pthread_mutex_lock(&work->lock);
+        if (fwrite(&record, sizeof(BookRecord), 1, work->log) != 1 || fflush(work->log) != 0)
+            work->error = 1;
+        unsigned long long done = ++work->done;
+        pthread_mutex_unlock(&work->lock);
+
+        if (done % 1000 == 0)
+            printf("Solved: %llu / %llu\n", done, work->count);
+    }
+
+    return NULL;
+}
+
+// build an opening book of every position reachable through non losing moves in the first depth moves
+// book [-shard i/n] [-split ply] [-known book] <depth> <output>
+// The unique positions are enumerated level by level, the leaves are solved in parallel and the values
+// are propagated back to the root before the whole book is written at once. Every solved leaf is first
+// appended to <output>.part, running the same build again after an interruption carries on from there.
+// A build with -shard i/n only solves the leaves below every n-th frontier position (at the split ply,
+// the same in every shard) and writes them, merge combines the shards into the book. Leaves found in
+// a -known book, an earlier book or shard, are taken from it
+int computeBook(int argc, char* argv[]) {
+    // positions of larger boards don't fit in a book record, nor in a record of the checkpoint
+    if (!BOOK_FITS) {
+        printf("Books need a board of at most 48 bits\n");
+        return 1;
+    }
+
+    int depth = -1;
+    int split = BOOK_SPLIT_PLY;
+    int shard = 0;
+    int shards = 1;
+    char* path = NULL;
+    Book* known[BOOK_MAX_KNOWN];
+    int knownCount = 0;
+    int result = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-shard") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d/%d", &shard, &shards) != 2)
+                shards = 0;
+        }
+        else if (strcmp(argv[i], "-split") == 0 && i + 1 < argc) {
+            split = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-known") == 0 && i + 1 < argc) {
+            i++;
+            int error = BOOK_OPEN_ERROR;
+            if (knownCount < BOOK_MAX_KNOWN && (known[knownCount] = openBook(argv[i], &error)) != NULL) {
+                knownCount++;
+            }
+            else {
+                printf("Book %s %s\n", argv[i], bookError(error));
+                result = 1;
+            }
+        }
+        else if (depth < 0) {
+            depth = atoi(argv[i]);
+        }
+        else {
+            path = argv[i];
+        }
+    }
+
+    if (result || path == NULL || depth < 0 || split < 0 || shards < 1 || shard < 0 || shard >= shards) {
+        if (!result)
+            printf("Usage: book [-shard i/n] [-split ply] [-known book] <depth> <output>\n");
+        for (int i = 0; i < knownCount; i++) {
+            closeBook(known[i]);
+        }
+        return 1;
+    }
+    if (split > depth)
+        split = depth;
+
+    BookNode** levels = malloc(sizeof(BookNode*) * (depth + 1));
+    unsigned long long* counts = malloc(sizeof(unsigned long long) * (depth + 1));
+    unsigned long long leafCount = enumerateTree(depth, split, levels, counts);
+
+    // the leaves of the shard that no book or earlier run of the build has solved
+    char* logPath = malloc(strlen(path) + 6);
+    sprintf(logPath, "%s.part", path);
+    Book* solved = openBookLog(logPath);
+
+    BookWork work;
+    memset(&work, 0, sizeof(BookWork));
+    work.leaves = malloc(sizeof(BookNode*) * (leafCount ? leafCount : 1));
+    unsigned long long shardLeaves = 0;
+    unsigned long long resumed = 0;
+    for (int d = 0; d <= depth; d++) {
+        for (unsigned long long i = 0; i < counts[d]; i++) {
+            BookNode* node = &levels[d][i];
+            if (!node->leaf || node->frontier % shards != (unsigned int)shard)
+                continue;
+
+            shardLeaves++;
+            if (lookupNode(known, knownCount, node, d))
+                continue;
+
+            int move;
+            int eval;
+            if (solved != NULL && probeBook(solved, node->mine, node->theirs, &move, &eval)) {
+                node->move = move;
+                node->eval = eval;
+                node->known = 1;
+                resumed++;
+                continue;
+            }
+            work.leaves[work.count++] = node;
+        }
+    }
+    printf("Leaves: %llu  Known: %llu  Resumed: %llu  Solving: %llu\n",
+           shardLeaves, shardLeaves - resumed - work.count, resumed, work.count);
+
+    work.log = fopen(logPath, "ab");
+    if (work.log == NULL) {
+        printf("Error opening file %s\n", logPath);
+        result = 1;
+    }
+    else {
+        work.table = initHashTable();
+        pthread_mutex_init(&work.lock, NULL);
+
+        int threads = getThreadCount();
+        pthread_t* handles = malloc(sizeof(pthread_t) * threads);
+        for (int i = 1; i < threads; i++) {
+            pthread_create(&handles[i], NULL, bookWorker, &work);
+        }
+        bookWorker(&work);
+        for (int i = 1; i < threads; i++) {
+            pthread_join(handles[i], NULL);
+        }
+
+        work.error |= fclose(work.log) != 0;
+        if (work.error) {
+            printf("Error writing file %s\n", logPath);
+            result = 1;
+        }
+
+        pthread_mutex_destroy(&work.lock);
+        freeHashTable(work.table);
+        free(handles);
+    }
+
+    // the checkpoint is only removed once the book is written
+    if (result == 0) {
+        if (shards == 1)
+            propagateValues(levels, counts, depth);
+        result = writeTree(path, levels, counts, depth, shard, shards, !WEAK_BOOK && booksExact(known, knownCount));
+        if (result == 0)
+            remove(logPath);
+    }
+
+    if (solved != NULL)
+        closeBook(solved);
+    for (int i = 0; i < knownCount; i++) {
+        closeBook(known[i]);
+    }
+    freeTree(levels, counts, depth);
+    free(work.leaves);
+    free(logPath);
+
+    return result;
+}
+
+// combine books and book shards into the book of every position to depth, the values of the leaves
+// are taken from the books and every position above them is propagated again from its children
+// merge <depth> <output> <books>
+int mergeBooks(int argc, char* argv[]) {
+    if (!BOOK_FITS) {
+        printf("Books need a board of at most 48 bits\n");
+        return 1;
+    }
+
+    if (argc < 3 || atoi(argv[0]) < 0) {
+        printf("Usage: merge <depth> <output> <books>\n");
+        return 1;
+    }
+
+    int depth = atoi(argv[0]);
+    char* path = argv[1];
+    int bookCount = argc - 2;
+    Book** books = malloc(sizeof(Book*) * bookCount);
+    int result = 0;
+
+    for (int i = 0; i < bookCount; i++) {
+        int error;
+        books[i] = openBook(argv[i + 2], &error);
+        if (books[i] == NULL) {
+            printf("Book %s %s\n", argv[i + 2], bookError(error));
+            result = 1;
+        }
+    }
+
+    if (result == 0) {
+        BookNode** levels = malloc(sizeof(BookNode*) * (depth + 1));
+        unsigned long long* counts = malloc(sizeof(unsigned long long) * (depth + 1));
+        enumerateTree(depth, 0, levels, counts);
+
+        for (int d = 0; d <= depth; d++) {
+            for (unsigned long long i = 0; i < counts[d]; i++) {
+                lookupNode(books, bookCount, &levels[d][i], d);
+            }
+        }
+
+        // a book with positions whose value isn't known would give wrong moves, nothing is written
+        unsigned long long missing = propagateValues(levels, counts, depth);
+        if (missing) {
+            printf("Missing: %llu positions, every shard of the depth is needed\n", missing);
+            result = 1;
+        }
+        else {
+            result = writeTree(path, levels, counts, depth, 0, 1, booksExact(books, bookCount));
+        }
+
+        freeTree(levels, counts, depth);
+    }
+
+    for (int i = 0; i < bookCount; i++) {
+        if (books[i] != NULL)
+            closeBook(books[i]);
+    }
+    free(books);
+    return result;
+}
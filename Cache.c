@@ -0,0 +1,273 @@
+#include <string.h>
+#include <sys/stat.h>
+#include "Main.h"
+
+#define CACHE_READ_BLOCK 4096 // appended records read at once
+
+// A record's key and its index in the order the records were appended
+typedef struct {
+    unsigned long long key;
+    unsigned long long index;
+} RecordOrder;
+
+static int compareRecordOrders(const void* a, const void* b) {
+    const RecordOrder* x = (const RecordOrder*)a;
+    const RecordOrder* y = (const RecordOrder*)b;
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// sort records given in the order they were appended by key and keep the newest record of every key,
+// returns the number of records kept. Records of a key are ordered by their index since qsort isn't stable
+static unsigned long long sortNewest(CacheRecord* records, unsigned long long count) {
+    RecordOrder* order = malloc((count ? count : 1) * sizeof(RecordOrder));
+    CacheRecord* sorted = malloc((count ? count : 1) * sizeof(CacheRecord));
+
+    for (unsigned long long i = 0; i < count; i++) {
+        order[i].key = records[i].key;
+        order[i].index = i;
+    }
+    qsort(order, count, sizeof(RecordOrder), compareRecordOrders);
+
+    unsigned long long unique = 0;
+    for (unsigned long long i = 0; i < count; i++) {
+        if (i + 1 < count && order[i + 1].key == order[i].key)
+            continue;
+        sorted[unique++] = records[order[i].index];
+    }
+    memcpy(records, sorted, unique * sizeof(CacheRecord));
+
+    free(order);
+    free(sorted);
+    return unique;
+}
+
+// index of the first record whose key is not below key
+static unsigned long long lowerBound(const CacheRecord* records, unsigned long long count, unsigned long long key) {
+    unsigned long long low = 0;
+    unsigned long long high = count;
+
+    while (low < high) {
+        unsigned long long mid = low + (high - low) / 2;
+        if (records[mid].key < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+static const CacheRecord* findRecord(const CacheRecord* records, unsigned long long count, unsigned long long key) {
+    unsigned long long i = lowerBound(records, count, key);
+    return (i < count && records[i].key == key) ? &records[i] : NULL;
+}
+
+static void reserveRecent(SolveCache* cache, unsigned long long count) {
+    if (count <= cache->recentCapacity)
+        return;
+
+    while (cache->recentCapacity < count) {
+        cache->recentCapacity = (cache->recentCapacity) ? cache->recentCapacity * 2 : 1024;
+    }
+    cache->recent = realloc(cache->recent, cache->recentCapacity * sizeof(CacheRecord));
+}
+
+// add a record this process solved, the scores of a position are exact so a record of the same key is just replaced
+static void addRecent(SolveCache* cache, CacheRecord* record) {
+    unsigned long long i = lowerBound(cache->recent, cache->recentCount, record->key);
+    if (i < cache->recentCount && cache->recent[i].key == record->key) {
+        cache->recent[i] = *record;
+        return;
+    }
+
+    reserveRecent(cache, cache->recentCount + 1);
+    memmove(&cache->recent[i + 1], &cache->recent[i], (cache->recentCount - i) * sizeof(CacheRecord));
+    cache->recent[i] = *record;
+    cache->recentCount++;
+}
+
+// read the records appended to the file since it was last read, by this process or any other
+static void readAppended(SolveCache* cache) {
+    FILE* file = fopen(cache->path, "rb");
+    if (file == NULL || fseek(file, (long)cache->readSize, SEEK_SET) != 0) {
+        if (file != NULL)
+            fclose(file);
+        return;
+    }
+
+    // a record still being appended is left for the next read
+    size_t read;
+    reserveRecent(cache, cache->recentCount + CACHE_READ_BLOCK);
+    while ((read = fread(&cache->recent[cache->recentCount], sizeof(CacheRecord), CACHE_READ_BLOCK, file)) > 0) {
+        cache->recentCount += read;
+        cache->readSize += read * sizeof(CacheRecord);
+        reserveRecent(cache, cache->recentCount + CACHE_READ_BLOCK);
+    }
+    fclose(file);
+
+    // the records read so far come before the ones just read, so the last appended record of a key is kept
+    cache->recentCount = sortNewest(cache->recent, cache->recentCount);
+}
+
+// a cache file of this version and board size
+static int validHeader(const void* base, size_t length) {
+    const CacheHeader* header = (const CacheHeader*)base;
+    return base != NULL && length >= sizeof(CacheHeader) && memcmp(header->magic, CACHE_MAGIC, 8) == 0
+        && header->width == WIDTH && header->height == HEIGHT;
+}
+
+static void initHeader(CacheHeader* header, unsigned long long sorted) {
+    memset(header, 0, sizeof(CacheHeader));
+    memcpy(header->magic, CACHE_MAGIC, 8);
+    header->sorted = sorted;
+    header->width = WIDTH;
+    header->height = HEIGHT;
+}
+
+// open a cache file for reading and appending, it is created if it doesn't exist
+SolveCache* openCache(const char* path) {
+#ifdef BITBOARD_128
+    // keys of 128-bit boards are folded to 64 bits and no longer identify a position
+    return NULL;
+#endif
+
+    FILE* log = fopen(path, "ab");
+    if (log == NULL)
+        return NULL;
+
+    fseek(log, 0, SEEK_END);
+    if (ftell(log) == 0) {
+        CacheHeader header;
+        initHeader(&header, 0);
+        fwrite(&header, sizeof(CacheHeader), 1, log);
+        fflush(log);
+    }
+
+    SolveCache* cache = calloc(1, sizeof(SolveCache));
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->log = log;
+    cache->path = strdup(path);
+    cache->base = mapFile(path, &cache->length);
+
+    const CacheHeader* header = (const CacheHeader*)cache->base;
+    if (!validHeader(cache->base, cache->length) || sizeof(CacheHeader) + header->sorted * sizeof(CacheRecord) > cache->length) {
+        closeCache(cache);
+        return NULL;
+    }
+
+    cache->records = (const CacheRecord*)((const char*)cache->base + sizeof(CacheHeader));
+    cache->count = header->sorted;
+    cache->readSize = sizeof(CacheHeader) + header->sorted * sizeof(CacheRecord);
+    readAppended(cache);
+    cache->checked = getTime();
+    return cache;
+}
+
+void closeCache(SolveCache* cache) {
+    if (cache->base != NULL)
+        unmapFile(cache->base, cache->length);
+    pthread_mutex_destroy(&cache->lock);
+    fclose(cache->log);
+    free(cache->recent);
+    free(cache->path);
+    free(cache);
+}
+
+// look up the exact score and move of a table key, returns 0 if it was never solved.
+// Before a miss is reported the records other processes appended since the last read are read,
+// the file is looked at once every CACHE_CHECK_INTERVAL so a run of misses doesn't stat it every time
+int probeCache(SolveCache* cache, unsigned long long key, int* score, int* move) {
+    pthread_mutex_lock(&cache->lock);
+
+    const CacheRecord* record = findRecord(cache->recent, cache->recentCount, key);
+    if (record == NULL)
+        record = findRecord(cache->records, cache->count, key);
+
+    struct stat st;
+    double now = (record == NULL) ? getTime() : 0;
+    if (record == NULL && now - cache->checked >= CACHE_CHECK_INTERVAL) {
+        cache->checked = now;
+        if (stat(cache->path, &st) == 0 && (unsigned long long)st.st_size >= cache->readSize + sizeof(CacheRecord)) {
+            readAppended(cache);
+            record = findRecord(cache->recent, cache->recentCount, key);
+        }
+    }
+
+    if (record != NULL) {
+        *score = record->score;
+        *move = record->move;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return record != NULL;
+}
+
+// append an exact solve to the file, a record is written whole so readers never see part of it
+int storeCache(SolveCache* cache, unsigned long long key, int score, int move) {
+    CacheRecord record;
+    memset(&record, 0, sizeof(CacheRecord));
+    record.key = key;
+    record.score = score;
+    record.move = move;
+
+    pthread_mutex_lock(&cache->lock);
+    int written = fwrite(&record, sizeof(CacheRecord), 1, cache->log) == 1 && fflush(cache->log) == 0;
+    addRecent(cache, &record);
+    pthread_mutex_unlock(&cache->lock);
+
+    return written ? 0 : 1;
+}
+
+// merge the appended records into the sorted part, run it while nothing has the cache open:
+// the compacted cache replaces the file and records appended to the old file are lost
+int compactCache(const char* path) {
+    size_t length = 0;
+    void* base = mapFile(path, &length);
+    if (!validHeader(base, length)) {
+        if (base != NULL)
+            unmapFile(base, length);
+        printf("Error opening file %s, it needs to be a solve cache of a %dx%d board\n", path, WIDTH, HEIGHT);
+        return 1;
+    }
+
+    unsigned long long count = (length - sizeof(CacheHeader)) / sizeof(CacheRecord);
+    CacheRecord* records = malloc((count ? count : 1) * sizeof(CacheRecord));
+    memcpy(records, (const char*)base + sizeof(CacheHeader), count * sizeof(CacheRecord));
+    unmapFile(base, length);
+
+    // the sorted part comes first and the appended records follow in the order they were solved
+    unsigned long long unique = sortNewest(records, count);
+
+    // write a new file and move it over the old one, open readers keep their mapping of the old file
+    char* tmpPath = malloc(strlen(path) + 5);
+    sprintf(tmpPath, "%s.tmp", path);
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        printf("Error opening file %s\n", tmpPath);
+        free(tmpPath);
+        free(records);
+        return 1;
+    }
+
+    CacheHeader compacted;
+    initHeader(&compacted, unique);
+    int result = fwrite(&compacted, sizeof(CacheHeader), 1, file) != 1
+              || fwrite(records, sizeof(CacheRecord), unique, file) != unique;
+    result |= fclose(file) != 0;
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (result || rename(tmpPath, path) != 0) {
+        printf("Error writing file %s\n", path);
+        result = 1;
+    }
+    else {
+        printf("Cache positions: %llu\n", unique);
+    }
+
+    free(tmpPath);
+    free(records);
+    return result;
+}
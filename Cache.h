@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define CACHE_MAGIC "C4CACHE\2" // version 2 gives the board size
+#define CACHE_CHECK_INTERVAL 1.0 // seconds between looks for records appended by other processes
+
+// A solved position, the key is the table key of the position so mirror images share a record.
+// The score is exact for the player to move and the move is for the orientation of the key
+typedef struct {
+    unsigned long long key;
+    signed char score;
+    signed char move;
+    char unused[6];
+} CacheRecord;
+
+// Header of a cache file, followed by sorted records sorted by key and then by the records
+// appended since, in the order they were solved. Compaction sorts the appended records in
+typedef struct {
+    char magic[8];
+    unsigned long long sorted;
+    unsigned int width; // keys of other board sizes are other positions
+    unsigned int height;
+} CacheHeader;
+
+// A cache of exact solves kept on disk across runs. The sorted part is memory-mapped, appended
+// records are read into memory and solves are appended as whole records, so any number of
+// processes can read and append to one file while it is not being compacted
+typedef struct {
+    const CacheRecord* records; // the sorted part
+    unsigned long long count;
+    void* base;
+    size_t length;
+    CacheRecord* recent; // appended records sorted by key, newest wins
+    unsigned long long recentCount;
+    unsigned long long recentCapacity;
+    unsigned long long readSize; // bytes of the file read so far
+    double checked; // getTime() of the last look at the file size
+    char* path;
+    FILE* log;
+    pthread_mutex_t lock;
+} SolveCache;
+
+SolveCache* openCache(const char* path);
+void closeCache(SolveCache* cache);
+int probeCache(SolveCache* cache, unsigned long long key, int* score, int* move);
+int storeCache(SolveCache* cache, unsigned long long key, int score, int move);
+int compactCache(const char* path);
+
+#endif // CACHE_H
@@ -0,0 +1,418 @@
+#include "Main.h"
+
+struct Engine {
+    HashTable* table;
+    Book* book;
+    SolveCache* cache;
+    int threads;
+    int weak;
+    double timeLimit; // seconds per solve, 0 for none
+    SearchStats stats; // of every solve since the last reset
+    pthread_mutex_t statsLock;
+    Ponder ponder;
+    pthread_mutex_t ponderLock;
+    int sessionMode; // solves are positions of one game, see engineSetSession
+    GameSession session;
+    pthread_mutex_t sessionLock;
+};
+
+Engine* engineCreate(unsigned long long tableMB, int threads) {
+    Engine* engine = malloc(sizeof(Engine));
+    if (engine == NULL)
+        return NULL;
+
+    engine->table = (tableMB > 0) ? initHashTableSize(tableMB) : initHashTable();
+    if (engine->table == NULL) {
+        free(engine);
+        return NULL;
+    }
+
+    engine->book = NULL;
+    engine->cache = NULL;
+    engine->weak = 0;
+    engine->timeLimit = 0;
+    memset(&engine->stats, 0, sizeof(SearchStats));
+    pthread_mutex_init(&engine->statsLock, NULL);
+    memset(&engine->ponder, 0, sizeof(Ponder));
+    pthread_mutex_init(&engine->ponderLock, NULL);
+    engine->sessionMode = 0;
+    initSession(&engine->session, engine->table);
+    pthread_mutex_init(&engine->sessionLock, NULL);
+    engineSetThreads(engine, threads);
+    return engine;
+}
+
+void engineFree(Engine* engine) {
+    engineStopPonder(engine);
+    if (engine->book != NULL)
+        closeBook(engine->book);
+    if (engine->cache != NULL)
+        closeCache(engine->cache);
+    freeHashTable(engine->table);
+    pthread_mutex_destroy(&engine->statsLock);
+    pthread_mutex_destroy(&engine->ponderLock);
+    pthread_mutex_destroy(&engine->sessionLock);
+    free(engine);
+}
+
+// positions found in the book are answered from it, a NULL path closes the book
+int engineSetBook(Engine* engine, const char* path) {
+    if (engine->book != NULL)
+        closeBook(engine->book);
+    engine->book = NULL;
+
+    if (path == NULL)
+        return ENGINE_OK;
+
+    int error;
+    engine->book = openBook(path, &error);
+    if (engine->book != NULL)
+        return ENGINE_OK;
+    return (error == BOOK_OPEN_ERROR) ? ENGINE_BOOK_ERROR : ENGINE_BOOK_FORMAT;
+}
+
+// exact solves are kept in the cache file across runs and positions in it are answered from it,
+// a NULL path closes the cache. Engines in other processes can share the file
+int engineSetCache(Engine* engine, const char* path) {
+    if (engine->cache != NULL)
+        closeCache(engine->cache);
+    engine->cache = NULL;
+
+    if (path == NULL)
+        return ENGINE_OK;
+
+    engine->cache = openCache(path);
+    return (engine->cache != NULL) ? ENGINE_OK : ENGINE_CACHE_ERROR;
+}
+
+void engineSetThreads(Engine* engine, int threads) {
+    if (threads < 1)
+        threads = 1;
+    else if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    engine->threads = threads;
+}
+
+void engineSetWeak(Engine* engine, int weak) {
+    engine->weak = weak != 0;
+}
+
+void engineSetTimeLimit(Engine* engine, double seconds) {
+    engine->timeLimit = (seconds > 0) ? seconds : 0;
+}
+
+void engineClear(Engine* engine) {
+    engineStopPonder(engine);
+    engineNewGame(engine);
+    clearHashTable(engine->table);
+}
+
+// set up the board from the stones of each player and check it can be played from
+static int readPosition(bitboard p1, bitboard p2, int player, BoardState* board) {
+    // every stone has to be on the board and rest on the bottom or on another stone
+    bitboard occupied = p1 | p2;
+    if ((p1 & p2) || (occupied & ~BOARD_MASK) || (occupied & ~((occupied << (WIDTH + 1)) | BOTTOM_MASK))
+        || (player != 0 && player != 1))
+        return ENGINE_INVALID_POSITION;
+
+    setBoard(board, p1, p2, player);
+    if (hasAlignment(p1) || hasAlignment(p2))
+        return ENGINE_GAME_OVER;
+    if (!generateMoves(board))
+        return ENGINE_BOARD_FULL;
+    return ENGINE_OK;
+}
+
+// play a move sequence, columns 1 to WIDTH as in the test files
+static int readMoves(const char* moves, BoardState* board, int* player) {
+    *player = 0;
+    initBoard(board);
+
+    for (; *moves != '\0'; moves++) {
+        if (*moves < '1' || *moves > '0' + WIDTH)
+            return ENGINE_INVALID_MOVE;
+
+        bitboard move = generateMoves(board) & (MOVE_MASK << (*moves - '1'));
+        if (!move)
+            return ENGINE_INVALID_MOVE;
+
+        makeMove(board, move);
+        if (isAligned(board))
+            return ENGINE_GAME_OVER;
+        *player = !*player;
+    }
+
+    return ENGINE_OK;
+}
+
+// look up the position in the solve cache under its table key, the move is mirrored if the key is the mirror image's
+static int probeSolved(SolveCache* cache, BoardState* board, int* score, int* move) {
+    bitboard key = positionKey(board);
+    if (!probeCache(cache, tableKey(board), score, move))
+        return 0;
+
+    if (mirrorBoard(key) < key && *move >= 0)
+        *move = WIDTH - 1 - *move;
+    return 1;
+}
+
+static void storeSolved(SolveCache* cache, BoardState* board, int score, int move) {
+    bitboard key = positionKey(board);
+    if (mirrorBoard(key) < key)
+        move = WIDTH - 1 - move;
+    storeCache(cache, tableKey(board), score, move);
+}
+
+// in session mode every solve is taken to be a position of the same game: a position reached from the
+// last one solved starts with a null window at its score and widens from there only if that fails,
+// and the principal variation of the last solve is pinned in the table. engineNewGame starts over
+void engineSetSession(Engine* engine, int session) {
+    engineNewGame(engine);
+    engine->sessionMode = session != 0;
+}
+
+void engineNewGame(Engine* engine) {
+    pthread_mutex_lock(&engine->sessionLock);
+    endSession(&engine->session);
+    pthread_mutex_unlock(&engine->sessionLock);
+}
+
+// a score found without a search still carries over to the next solve of the game
+static void noteScore(Engine* engine, BoardState* board, int score) {
+    if (!engine->sessionMode)
+        return;
+
+    pthread_mutex_lock(&engine->sessionLock);
+    updateSession(&engine->session, board, engine->weak, (engine->weak) ? (score > 0) - (score < 0) : score);
+    pthread_mutex_unlock(&engine->sessionLock);
+}
+
+// a book, cache or search result without a legal move gets the move a search would try first,
+// so a position that has a legal move always gets one
+static void checkMove(Engine* engine, BoardState* board, EngineResult* result) {
+    bitboard moves = generateMoves(board);
+    if (moves && (result->move < 0 || result->move >= WIDTH || !(moves & (MOVE_MASK << result->move))))
+        result->move = fallbackMove(board, engine->table);
+}
+
+// stop pondering, returns 1 with the result if the board is a reply that was solved meanwhile
+static int takePondered(Engine* engine, BoardState* board, SolveResult* result) {
+    pthread_mutex_lock(&engine->ponderLock);
+    stopPonder(&engine->ponder);
+    int found = engine->ponder.weak == engine->weak
+             && ponderResult(&engine->ponder, board, result);
+    pthread_mutex_unlock(&engine->ponderLock);
+    return found;
+}
+
+// solve the position with player 0 or 1 to move
+int engineSolve(Engine* engine, bitboard p1, bitboard p2, int player, EngineResult* result) {
+    BoardState board;
+    int error = readPosition(p1, p2, player, &board);
+    if (error != ENGINE_OK)
+        return error;
+
+    double start = getTime();
+    memset(result, 0, sizeof(EngineResult));
+    SolveResult solved;
+    int pondered = takePondered(engine, &board, &solved);
+
+    // the book is stored by the order the players moved in rather than by who is to move
+    int move;
+    int eval;
+    bitboard first, second;
+    getFirstStones(&board, &first, &second);
+    if (engine->book != NULL && probeBookStones(engine->book, first, second, &move, &eval)) {
+        // the weak solver only reports the sign of a score. A book that isn't exact only knows
+        // the sign too, which bounds the score of a win or a loss without giving it
+        int sign = (eval > 0) - (eval < 0);
+        int exact = engine->weak || engine->book->exact || sign == 0;
+        if (engine->weak || !exact)
+            eval = sign;
+        result->score = eval;
+        result->move = move;
+        result->complete = exact;
+        result->lower = (exact) ? eval : (sign > 0) ? 1 : -MAX_STONES;
+        result->upper = (exact) ? eval : (sign > 0) ? MAX_STONES : -1;
+        result->outcome = (sign > 0) ? OUTCOME_WIN : (sign < 0) ? OUTCOME_LOSS : OUTCOME_DRAW;
+        result->book = 1;
+        checkMove(engine, &board, result);
+        result->seconds = getTime() - start;
+        if (exact)
+            noteScore(engine, &board, eval);
+        return ENGINE_OK;
+    }
+
+    // the cache holds exact scores, the weak solver only reports their sign
+    int score;
+    if (engine->cache != NULL && probeSolved(engine->cache, &board, &score, &move)) {
+        if (engine->weak)
+            score = (score > 0) - (score < 0);
+        result->score = score;
+        result->move = move;
+        result->complete = 1;
+        result->lower = score;
+        result->upper = score;
+        result->outcome = (score > 0) ? OUTCOME_WIN : (score < 0) ? OUTCOME_LOSS : OUTCOME_DRAW;
+        result->cached = 1;
+        checkMove(engine, &board, result);
+        result->seconds = getTime() - start;
+        noteScore(engine, &board, score);
+        return ENGINE_OK;
+    }
+
+    if (pondered) {
+        noteScore(engine, &board, solved.eval);
+    }
+    else if (engine->sessionMode) {
+        // the solves of a session are taken one at a time
+        pthread_mutex_lock(&engine->sessionLock);
+        solveSession(&engine->session, &board, engine->weak, engine->threads, engine->timeLimit, &solved);
+        pthread_mutex_unlock(&engine->sessionLock);
+    }
+    else {
+        solvePosition(&board, engine->table, engine->weak, engine->threads, engine->timeLimit, &solved);
+    }
+    if (engine->cache != NULL && !engine->weak && solved.complete && solved.move >= 0)
+        storeSolved(engine->cache, &board, solved.eval, solved.move);
+
+#if SEARCH_STATS
+    pthread_mutex_lock(&engine->statsLock);
+    mergeStats(&engine->stats, &solved.stats);
+    pthread_mutex_unlock(&engine->statsLock);
+#endif
+
+    result->score = solved.eval;
+    result->move = solved.move;
+    result->nodes = solved.nodes;
+    result->seconds = getTime() - start;
+    result->complete = solved.complete;
+    result->lower = solved.lower;
+    result->upper = solved.upper;
+    result->outcome = solved.outcome;
+    result->pondered = pondered;
+    checkMove(engine, &board, result);
+    return ENGINE_OK;
+}
+
+// solve the position after a move sequence
+int engineSolveMoves(Engine* engine, const char* moves, EngineResult* result) {
+    BoardState board;
+    int player;
+    bitboard p1, p2;
+    int error = readMoves(moves, &board, &player);
+    if (error != ENGINE_OK)
+        return error;
+
+    getStones(&board, player, &p1, &p2);
+    return engineSolve(engine, p1, p2, player, result);
+}
+
+// score every column of the position, the analysis always runs to the end and ignores the time limit and the book
+int engineAnalyze(Engine* engine, bitboard p1, bitboard p2, int player, EngineAnalysis* analysis) {
+    char columnOrder[WIDTH];
+    centerOrder(columnOrder);
+    BoardState board;
+    int error = readPosition(p1, p2, player, &board);
+    if (error != ENGINE_OK)
+        return error;
+
+    double start = getTime();
+    engineStopPonder(engine);
+    analysis->nodes = analyzePosition(&board, engine->table, engine->weak, engine->threads, analysis->scores);
+    analysis->seconds = getTime() - start;
+
+    analysis->move = -1;
+    analysis->score = ENGINE_NO_SCORE;
+    for (int i = 0; i < WIDTH; i++) {
+        if (analysis->scores[(int)columnOrder[i]] > analysis->score) {
+            analysis->move = columnOrder[i];
+            analysis->score = analysis->scores[(int)columnOrder[i]];
+        }
+    }
+    return ENGINE_OK;
+}
+
+int engineAnalyzeMoves(Engine* engine, const char* moves, EngineAnalysis* analysis) {
+    BoardState board;
+    int player;
+    bitboard p1, p2;
+    int error = readMoves(moves, &board, &player);
+    if (error != ENGINE_OK)
+        return error;
+
+    getStones(&board, player, &p1, &p2);
+    return engineAnalyze(engine, p1, p2, player, analysis);
+}
+
+// solve the replies to the position with player (the opponent) to move in the background until the
+// next solve, analysis or engineStopPonder(). The replies go into the table in the order the search
+// would try them, and a reply that was solved completely is answered by engineSolve() without a search
+int enginePonder(Engine* engine, bitboard p1, bitboard p2, int player) {
+    BoardState board;
+    int error = readPosition(p1, p2, player, &board);
+    if (error != ENGINE_OK)
+        return error;
+
+    pthread_mutex_lock(&engine->ponderLock);
+    stopPonder(&engine->ponder);
+    startPonder(&engine->ponder, &board, engine->table, engine->weak, engine->threads);
+    pthread_mutex_unlock(&engine->ponderLock);
+    return ENGINE_OK;
+}
+
+int enginePonderMoves(Engine* engine, const char* moves) {
+    BoardState board;
+    int player;
+    bitboard p1, p2;
+    int error = readMoves(moves, &board, &player);
+    if (error != ENGINE_OK)
+        return error;
+
+    getStones(&board, player, &p1, &p2);
+    return enginePonder(engine, p1, p2, player);
+}
+
+void engineStopPonder(Engine* engine) {
+    pthread_mutex_lock(&engine->ponderLock);
+    stopPonder(&engine->ponder);
+    pthread_mutex_unlock(&engine->ponderLock);
+}
+
+// the search statistics of the engine's solves since the last reset, returns 0 if
+// the library was built without SEARCH_STATS and the statistics are all zero
+int engineStats(Engine* engine, SearchStats* stats) {
+    pthread_mutex_lock(&engine->statsLock);
+    *stats = engine->stats;
+    pthread_mutex_unlock(&engine->statsLock);
+    return SEARCH_STATS;
+}
+
+void engineResetStats(Engine* engine) {
+    pthread_mutex_lock(&engine->statsLock);
+    memset(&engine->stats, 0, sizeof(SearchStats));
+    pthread_mutex_unlock(&engine->statsLock);
+}
+
+const char* engineError(int code) {
+    switch (code) {
+    case ENGINE_OK:
+        return "ok";
+    case ENGINE_INVALID_POSITION:
+        return "invalid position";
+    case ENGINE_INVALID_MOVE:
+        return "invalid move";
+    case ENGINE_GAME_OVER:
+        return "game is over";
+    case ENGINE_BOARD_FULL:
+        return "board is full";
+    case ENGINE_BOOK_ERROR:
+        return "error opening the book";
+    case ENGINE_CACHE_ERROR:
+        return "error opening the solve cache";
+    case ENGINE_BOOK_FORMAT:
+        return "the book uses an old format or another board size";
+    }
+    return "unknown error";
+}
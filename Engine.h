@@ -0,0 +1,71 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+// Engine API for embedding the solver. An engine owns its table, book and options,
+// so separate engines share no state and can be used from different threads at once.
+// One engine can also be solved on from several threads while its options are not changed.
+// Nothing here prints. Positions are bitboards of the board size the library was built for
+
+#include "Board.h"
+#include "Stats.h"
+
+#define ENGINE_OK 0
+#define ENGINE_INVALID_POSITION -1 // stones off the board, floating or on both sides
+#define ENGINE_INVALID_MOVE -2 // a move sequence with a bad column or a move into a full column
+#define ENGINE_GAME_OVER -3 // a player already has four in a row
+#define ENGINE_BOARD_FULL -4
+#define ENGINE_BOOK_ERROR -5 // the book could not be opened
+#define ENGINE_CACHE_ERROR -6 // the solve cache could not be opened
+#define ENGINE_BOOK_FORMAT -7 // the book is a compiled book of an earlier version or another board size
+
+typedef struct Engine Engine;
+
+// Result of solving a position, the score is for the player to move
+typedef struct {
+    int score; // valid when complete or found in the book
+    int move; // column 0 to WIDTH - 1, -1 only if the position has no legal move
+    unsigned long long nodes;
+    double seconds;
+    int complete; // 0 if the time limit ran out, the score is then only known to be in [lower, upper]
+    int lower;
+    int upper;
+    int outcome; // OUTCOME_WIN, OUTCOME_DRAW, OUTCOME_LOSS or OUTCOME_UNKNOWN
+    int book; // 1 if the position was found in the book, the score is then the book's eval or only its sign if the book isn't exact
+    int cached; // 1 if the position was found in the solve cache
+    int pondered; // 1 if the position was solved while pondering, the nodes are then those of that solve
+} EngineResult;
+
+#define ENGINE_COLUMNS WIDTH
+#define ENGINE_NO_SCORE -100 // score of a column that can't be played
+
+// Score of every column for the player to move
+typedef struct {
+    int scores[ENGINE_COLUMNS];
+    int move; // the best column, the first from the center on ties
+    int score;
+    unsigned long long nodes;
+    double seconds;
+} EngineAnalysis;
+
+Engine* engineCreate(unsigned long long tableMB, int threads); // 0 MB for the default table size
+void engineFree(Engine* engine);
+int engineSetBook(Engine* engine, const char* path);
+int engineSetCache(Engine* engine, const char* path);
+void engineSetThreads(Engine* engine, int threads);
+void engineSetWeak(Engine* engine, int weak);
+void engineSetTimeLimit(Engine* engine, double seconds);
+void engineClear(Engine* engine);
+void engineSetSession(Engine* engine, int session);
+void engineNewGame(Engine* engine);
+int engineSolve(Engine* engine, bitboard p1, bitboard p2, int player, EngineResult* result);
+int engineSolveMoves(Engine* engine, const char* moves, EngineResult* result);
+int engineAnalyze(Engine* engine, bitboard p1, bitboard p2, int player, EngineAnalysis* analysis);
+int engineAnalyzeMoves(Engine* engine, const char* moves, EngineAnalysis* analysis);
+int enginePonder(Engine* engine, bitboard p1, bitboard p2, int player);
+int enginePonderMoves(Engine* engine, const char* moves);
+void engineStopPonder(Engine* engine);
+int engineStats(Engine* engine, SearchStats* stats);
+void engineResetStats(Engine* engine);
+const char* engineError(int code);
+
+#endif // ENGINE_H
@@ -0,0 +1,290 @@
+#include "Main.h"
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+#endif
+
+#define SAMPLE_MAGIC "C4SAMPL\1"
+#define SAMPLE_COUNT 100000 // default positions to generate
+#define SAMPLE_CHUNK 1024 // default records per chunk
+#define SAMPLE_MIN_PLY 12
+#define SAMPLE_MAX_PLY 36
+#define SAMPLE_SCORES ((WIDTH + 8) / 8 * 8 - 1) // WIDTH padded so a record is a multiple of 8 bytes
+#define SELFPLAY_RANDOM 10 // percent of self-play moves chosen at random instead of the best one
+
+// A labelled position. p1 holds the stones of the player who moved first, so the player to move is
+// ply & 1 (0 for p1). The scores are those of engineAnalyze for the player to move: NO_SCORE for a
+// full column (and the padding), 0 for a draw, otherwise positive for a win and larger the sooner
+// it comes, or only -1, 0, 1 in weak files
+typedef struct {
+    unsigned long long p1;
+    unsigned long long p2;
+    signed char scores[SAMPLE_SCORES];
+    unsigned char ply;
+} SampleRecord;
+
+// Header of a sample file, followed by count records. The records are written in chunks of
+// chunkRecords, each chunk to its place in the file as a worker finishes it, and the count is
+// only written once every chunk is, so a file with count 0 is incomplete
+typedef struct {
+    char magic[8];
+    unsigned long long count;
+    unsigned int width;
+    unsigned int height;
+    unsigned int recordSize;
+    unsigned int chunkRecords;
+    unsigned int weak;
+    unsigned int selfPlay;
+    unsigned long long seed;
+} SampleHeader;
+
+// Chunks are handed to the workers one at a time, the workers share the table
+typedef struct {
+    HashTable* table;
+    FILE* file;
+    pthread_mutex_t lock;
+    unsigned long long count;
+    unsigned long long chunkRecords;
+    unsigned long long chunks;
+    unsigned long long next;
+    unsigned long long done;
+    unsigned long long nodes;
+    unsigned long long seed;
+    int minPly;
+    int maxPly;
+    int weak;
+    int selfPlay;
+    int error;
+    double start;
+} SampleWork;
+
+// splitmix64, every chunk has its own generator so a file only depends on the seed
+static unsigned long long nextRandom(unsigned long long* state) {
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static bitboard randomMove(bitboard moves, unsigned long long* rng) {
+    int skip = (int)(nextRandom(rng) % countStones(moves));
+    for (int i = 0; i < skip; i++) {
+        moves &= moves - 1;
+    }
+    return moves & -moves;
+}
+
+// play random moves from the empty board up to ply stones, returns 0 if the game ended before
+static int randomPosition(BoardState* board, int ply, unsigned long long* rng) {
+    initBoard(board);
+
+    for (int i = 0; i < ply; i++) {
+        bitboard moves = generateMoves(board);
+        if (!moves)
+            return 0;
+
+        makeMove(board, randomMove(moves, rng));
+        if (isAligned(board))
+            return 0;
+    }
+
+    return generateMoves(board) != 0;
+}
+
+// label the position with the score of every column, returns the best score
+static int labelPosition(SampleWork* work, BoardState* board, int ply, SampleRecord* record) {
+    int scores[WIDTH];
+    unsigned long long nodes = analyzePosition(board, work->table, work->weak, 1, scores);
+    __atomic_add_fetch(&work->nodes, nodes, __ATOMIC_RELAXED);
+
+    bitboard p1, p2;
+    getStones(board, ply & 1, &p1, &p2);
+    record->p1 = p1;
+    record->p2 = p2;
+    record->ply = ply;
+    memset(record->scores, NO_SCORE, SAMPLE_SCORES);
+
+    int best = NO_SCORE;
+    for (int i = 0; i < WIDTH; i++) {
+        record->scores[i] = scores[i];
+        if (scores[i] > best)
+            best = scores[i];
+    }
+    return best;
+}
+
+// the next self-play move, a random best column or now and then any column
+static bitboard selfPlayMove(BoardState* board, SampleRecord* record, int best, unsigned long long* rng) {
+    bitboard moves = generateMoves(board);
+    if (nextRandom(rng) % 100 < SELFPLAY_RANDOM)
+        return randomMove(moves, rng);
+
+    bitboard bestMoves = 0;
+    for (int i = 0; i < WIDTH; i++) {
+        if (record->scores[i] == best)
+            bestMoves |= moves & (MOVE_MASK << i);
+    }
+    return randomMove(bestMoves, rng);
+}
+
+// fill a chunk with positions at a random ply, each from its own random game
+static void sampleRandom(SampleWork* work, SampleRecord* records, unsigned long long size, unsigned long long* rng) {
+    BoardState board;
+
+    for (unsigned long long i = 0; i < size; i++) {
+        int ply;
+        do {
+            ply = work->minPly + (int)(nextRandom(rng) % (work->maxPly - work->minPly + 1));
+        } while (!randomPosition(&board, ply, rng));
+
+        labelPosition(work, &board, ply, &records[i]);
+    }
+}
+
+// fill a chunk with the positions of self-play games, the games open with random moves up to the
+// first ply and then follow the labels, every position from the first to the last ply is kept
+static void sampleSelfPlay(SampleWork* work, SampleRecord* records, unsigned long long size, unsigned long long* rng) {
+    BoardState board;
+    unsigned long long i = 0;
+
+    while (i < size) {
+        if (!randomPosition(&board, work->minPly, rng))
+            continue;
+
+        for (int ply = work->minPly; ply <= work->maxPly && i < size; ply++) {
+            int best = labelPosition(work, &board, ply, &records[i]);
+            bitboard move = selfPlayMove(&board, &records[i], best, rng);
+            i++;
+
+            makeMove(&board, move);
+            if (isAligned(&board) || !generateMoves(&board))
+                break;
+        }
+    }
+}
+
+static void* sampleWorker(void* arg) {
+    SampleWork* work = (SampleWork*)arg;
+    SampleRecord* records = malloc(work->chunkRecords * sizeof(SampleRecord));
+
+    while (1) {
+        unsigned long long chunk = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (chunk >= work->chunks)
+            break;
+
+        unsigned long long first = chunk * work->chunkRecords;
+        unsigned long long size = (work->count - first < work->chunkRecords) ? work->count - first : work->chunkRecords;
+        unsigned long long rng = work->seed ^ (chunk * 0xD1B54A32D192ED03ull);
+
+        if (work->selfPlay)
+            sampleSelfPlay(work, records, size, &rng);
+        else
+            sampleRandom(work, records, size, &rng);
+
+        pthread_mutex_lock(&work->lock);
+        if (fseeko(work->file, sizeof(SampleHeader) + first * sizeof(SampleRecord), SEEK_SET) != 0
+            || fwrite(records, sizeof(SampleRecord), size, work->file) != size) {
+            work->error = 1;
+        }
+        work->done += size;
+        double elapsed = getTime() - work->start;
+        printf("Generated: %llu / %llu, %.0f positions per hour\n", work->done, work->count, work->done / elapsed * 3600);
+        pthread_mutex_unlock(&work->lock);
+    }
+
+    free(records);
+    return NULL;
+}
+
+// generate solver labelled positions for training, every thread fills chunks of the file
+// generate [-count n] [-min ply] [-max ply] [-selfplay] [-weak] [-chunk records] [-seed n] <output>
+int generate(int argc, char* argv[]) {
+#ifdef BITBOARD_128
+    printf("Sample files store 64-bit boards\n");
+    return 1;
+#endif
+
+    SampleWork work;
+    memset(&work, 0, sizeof(SampleWork));
+    work.count = SAMPLE_COUNT;
+    work.chunkRecords = SAMPLE_CHUNK;
+    work.minPly = SAMPLE_MIN_PLY;
+    work.maxPly = SAMPLE_MAX_PLY;
+    char* path = NULL;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-count") == 0 && i + 1 < argc)
+            work.count = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-min") == 0 && i + 1 < argc)
+            work.minPly = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-max") == 0 && i + 1 < argc)
+            work.maxPly = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-selfplay") == 0)
+            work.selfPlay = 1;
+        else if (strcmp(argv[i], "-weak") == 0)
+            work.weak = 1;
+        else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc)
+            work.chunkRecords = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+            work.seed = strtoull(argv[++i], NULL, 10);
+        else
+            path = argv[i];
+    }
+
+    if (work.maxPly > WIDTH * HEIGHT - 1)
+        work.maxPly = WIDTH * HEIGHT - 1;
+    if (path == NULL || work.minPly < 0 || work.minPly > work.maxPly || work.chunkRecords == 0) {
+        printf("Usage: generate [-count n] [-min ply] [-max ply] [-selfplay] [-weak] [-chunk records] [-seed n] <output>\n");
+        return 1;
+    }
+
+    work.file = fopen(path, "wb");
+    if (work.file == NULL) {
+        printf("Error opening file %s\n", path);
+        return 1;
+    }
+
+    SampleHeader header;
+    memset(&header, 0, sizeof(SampleHeader));
+    memcpy(header.magic, SAMPLE_MAGIC, 8);
+    header.width = WIDTH;
+    header.height = HEIGHT;
+    header.recordSize = sizeof(SampleRecord);
+    header.chunkRecords = work.chunkRecords;
+    header.weak = work.weak;
+    header.selfPlay = work.selfPlay;
+    header.seed = work.seed;
+    work.error = fwrite(&header, sizeof(SampleHeader), 1, work.file) != 1;
+
+    work.chunks = (work.count + work.chunkRecords - 1) / work.chunkRecords;
+    work.table = initHashTable();
+    work.start = getTime();
+    pthread_mutex_init(&work.lock, NULL);
+
+    int threads = getThreadCount();
+    pthread_t* handles = malloc(sizeof(pthread_t) * threads);
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&handles[i], NULL, sampleWorker, &work);
+    }
+    sampleWorker(&work);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    // the count marks the file complete
+    header.count = work.count;
+    if (fseeko(work.file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(SampleHeader), 1, work.file) != 1)
+        work.error = 1;
+    work.error |= fclose(work.file) != 0;
+
+    double elapsed = getTime() - work.start;
+    if (work.error)
+        printf("Error writing file %s\n", path);
+    else
+        printf("Positions: %llu  Nodes: %llu  Time: %.3f s\n", work.count, work.nodes, elapsed);
+
+    pthread_mutex_destroy(&work.lock);
+    freeHashTable(work.table);
+    free(handles);
+    return work.error;
+}
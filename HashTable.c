@@ -1,101 +1,267 @@
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "HashTable.h"
 
-#define HASH_TABLE_SIZE 64ull // in MB
-#define MB_SIZE 1000000ull
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
-#define FAIL_HIGH 1
-#define FAIL_LOW 2
-#define EXACT 3
+// size used by initHashTable, set with setHashTableSize or -m on the command line
+static unsigned long long defaultSizeMB = HASH_TABLE_SIZE;
 
-#define MT_STATE_SIZE 624
+#define ENTRY_MOVE_SHIFT 8
+#define ENTRY_FLAG_SHIFT 12
+#define ENTRY_WORK_SHIFT 14
+#define ENTRY_KEY_SHIFT 21
+#define ENTRY_KEY_BITS 43
 
-// Random number generator (built in is not good enough)
-struct mt_state {
-    unsigned long long mt[MT_STATE_SIZE];
-    int index;
-};
+// map zeroed, page aligned memory for the table, trying huge pages first
+// since probes are random and a large table otherwise misses the TLB on nearly every probe
+static void* allocTable(unsigned long long bytes, unsigned long long* allocated, int* hugePages) {
+    // round up to whole huge pages so the mapping can be backed by them
+    bytes = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    *allocated = bytes;
 
-void mt_init(struct mt_state *state, unsigned long long seed) {
-    state->mt[0] = seed;
-    for (int i = 1; i < MT_STATE_SIZE; ++i) {
-        state->mt[i] = 0xFFFFFFFFFFFFFFFFull & (6364136223846793005ull * (state->mt[i - 1] ^ (state->mt[i - 1] >> 62)) + i);
+#ifdef _WIN32
+    // large pages need the SeLockMemoryPrivilege, fall back to normal pages without it
+    SIZE_T largePage = GetLargePageMinimum();
+    if (largePage && bytes % largePage == 0) {
+        void* memory = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (memory != NULL) {
+            *hugePages = 2;
+            return memory;
+        }
     }
-    state->index = MT_STATE_SIZE;
-}
 
-// Generate a 64-bit random number using the Mersenne Twister algorithm
-unsigned long long mt_rand(struct mt_state *state) {
-    if (state->index >= MT_STATE_SIZE) {
-        for (int i = 0; i < MT_STATE_SIZE; ++i) {
-            unsigned long long y = (state->mt[i] & 0x8000000000000000ull) + (state->mt[(i + 1) % MT_STATE_SIZE] & 0x7FFFFFFFFFFFFFFFull);
-            state->mt[i] = state->mt[(i + 397) % MT_STATE_SIZE] ^ (y >> 1);
-            if (y % 2 != 0) {
-                state->mt[i] ^= 0x9D2C5680u;
-            }
-        }
-        state->index = 0;
+    *hugePages = 0;
+    return VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* memory;
+#ifdef MAP_HUGETLB
+    // explicit huge pages only work if the admin reserved them (vm.nr_hugepages)
+    memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+        *hugePages = 2;
+        return memory;
     }
+#endif
 
-    unsigned long long y = state->mt[state->index];
-    y ^= (y >> 29) & 0x5555555555555555ull;
-    y ^= (y << 17) & 0x71D67FFFEDA60000ull;
-    y ^= (y << 37) & 0xFFF7EEE000000000ull;
-    y ^= y >> 43;
+    memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
 
-    state->index++;
+    *hugePages = 0;
+#ifdef MADV_HUGEPAGE
+    if (madvise(memory, bytes, MADV_HUGEPAGE) == 0)
+        *hugePages = 1;
+#endif
+    return memory;
+#endif
+}
 
-    return y;
+static void freeTable(void* memory, unsigned long long allocated) {
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, allocated);
+#endif
 }
 
-typedef struct {
-    unsigned long hash;
-    char value;
-    char move;
-    char flag;
-} Entry;
+static int cpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+#endif
+}
 
-typedef struct {
-    Entry* entries;
-    unsigned long* zobrist;
-    unsigned long long size;
-} HashTable;
+// largest prime that is not above n
+static unsigned long long previousPrime(unsigned long long n) {
+    for (; n > 2; n--) {
+        int prime = n & 1;
+        for (unsigned long long d = 3; prime && d * d <= n; d += 2) {
+            if (n % d == 0)
+                prime = 0;
+        }
+        if (prime)
+            return n;
+    }
+    return 2;
+}
 
+void setHashTableSize(unsigned long long sizeMB) {
+    defaultSizeMB = (sizeMB > 0) ? sizeMB : 1;
+}
 
 HashTable* initHashTable() {
+    return initHashTableSize(defaultSizeMB);
+}
+
+HashTable* initHashTableSize(unsigned long long sizeMB) {
     HashTable* table = malloc(sizeof(HashTable));
-    table->size = ((HASH_TABLE_SIZE * MB_SIZE) / sizeof(Entry));
-    table->entries = malloc(table->size * sizeof(Entry));
-
-    // Init the Zobrist hashing table
-    table->zobrist = malloc(sizeof(unsigned long) * 64 * 2);
-    struct mt_state state;
-    mt_init(&state, 0xdeadbeef);
-    for (int i = 0; i < 64 * 2; i++) {
-        table->zobrist[i] = (unsigned long)mt_rand(&state);
+    table->size = previousPrime((sizeMB * MB_SIZE) / sizeof(Bucket));
+
+    // the mapping is page aligned so the buckets are aligned to cache lines and a probe touches one line
+    table->memory = allocTable(table->size * sizeof(Bucket), &table->allocated, &table->hugePages);
+    if (table->memory == NULL) {
+        free(table);
+        return NULL;
     }
+    table->buckets = (Bucket*)table->memory;
+
+    // touch every page now, in parallel, instead of faulting them in during the first search
+    clearHashTable(table);
 
     return table;
 }
 
 void freeHashTable(HashTable* table) {
-    free(table->entries);
-    free(table->zobrist);
+    freeTable(table->memory, table->allocated);
     free(table);
 }
 
-Entry* getEntry(HashTable* table, unsigned long hash) {
-    if (table->entries[hash % table->size].hash == hash) {
-        return &table->entries[hash % table->size];
+typedef struct {
+    char* start;
+    unsigned long long length;
+} ClearRange;
+
+static void* clearWorker(void* arg) {
+    ClearRange* range = (ClearRange*)arg;
+    memset(range->start, 0, range->length);
+    return NULL;
+}
+
+// zero the table, large tables are split between one thread per cpu
+void clearHashTable(HashTable* table) {
+    unsigned long long bytes = table->size * sizeof(Bucket);
+    int threads = cpuCount();
+    unsigned long long chunks = bytes / CLEAR_CHUNK;
+
+    if ((unsigned long long)threads > chunks)
+        threads = (int)chunks;
+
+    if (threads <= 1) {
+        memset(table->buckets, 0, bytes);
+        return;
+    }
+
+    ClearRange* ranges = malloc(sizeof(ClearRange) * threads);
+    pthread_t* handles = malloc(sizeof(pthread_t) * threads);
+    unsigned long long part = (bytes / threads) & ~(CACHE_LINE - 1ull);
+
+    for (int i = 0; i < threads; i++) {
+        ranges[i].start = (char*)table->buckets + i * part;
+        ranges[i].length = (i == threads - 1) ? bytes - i * part : part;
+        if (i > 0)
+            pthread_create(&handles[i], NULL, clearWorker, &ranges[i]);
+    }
+    clearWorker(&ranges[0]);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(handles[i], NULL);
     }
-    return 0;
 
+    free(ranges);
+    free(handles);
 }
 
-void addEntry(HashTable* table, unsigned long hash, char value, char move, char flag) {
-    Entry* entry = table->entries + (hash % table->size);
-    entry->hash = hash;
-    entry->value = value;
-    entry->move = move;
-    entry->flag = flag;
+// the part of the key stored in an entry to tell positions in the same bucket apart
+static inline unsigned long long partialKey(unsigned long long key) {
+    return key & ((1ull << ENTRY_KEY_BITS) - 1);
 }
 
+static inline int entryWork(unsigned long long data) {
+    return (data >> ENTRY_WORK_SHIFT) & 0x7f;
+}
+
+// start loading the bucket of key into the cache ahead of a getEntry
+void prefetchEntry(HashTable* table, unsigned long long key) {
+    __builtin_prefetch(table->buckets + (key % table->size));
+}
+
+// copy the entry for key into entry, returns 0 if it is not in the table
+int getEntry(HashTable* table, unsigned long long key, Entry* entry) {
+    Bucket* bucket = table->buckets + (key % table->size);
+    unsigned long long partial = partialKey(key);
+
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        unsigned long long data = __atomic_load_n(&bucket->entries[i], __ATOMIC_RELAXED);
+
+        // empty entries have no flag
+        if ((data >> ENTRY_KEY_SHIFT) != partial || !((data >> ENTRY_FLAG_SHIFT) & 0x3))
+            continue;
+
+        int move = (data >> ENTRY_MOVE_SHIFT) & 0xf;
+        entry->key = key;
+        entry->value = (char)(data & 0xff);
+        entry->move = (move == 0xf) ? -1 : move;
+        entry->flag = (data >> ENTRY_FLAG_SHIFT) & 0x3;
+        entry->work = entryWork(data);
+        return 1;
+    }
+
+    return 0;
+}
+
+// store the entry, work is a measure of the effort spent on the result
+// (the log2 of the nodes searched) and decides which entry is replaced
+int addEntry(HashTable* table, unsigned long long key, char value, char move, char flag, int work) {
+    Bucket* bucket = table->buckets + (key % table->size);
+    unsigned long long partial = partialKey(key);
+
+    if (work > PINNED_WORK)
+        work = PINNED_WORK;
+
+    unsigned long long data = (unsigned long long)(unsigned char)value
+                            | (unsigned long long)(move & 0xf) << ENTRY_MOVE_SHIFT
+                            | (unsigned long long)(flag & 0x3) << ENTRY_FLAG_SHIFT
+                            | (unsigned long long)work << ENTRY_WORK_SHIFT
+                            | partial << ENTRY_KEY_SHIFT;
+
+    // overwrite the position if it is already in the bucket, otherwise
+    // replace the entry with the least work if the new one has more
+    int replace = 0;
+    int minWork = 0x80;
+    int match = -1;
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        unsigned long long old = __atomic_load_n(&bucket->entries[i], __ATOMIC_RELAXED);
+        if ((old >> ENTRY_KEY_SHIFT) == partial && ((old >> ENTRY_FLAG_SHIFT) & 0x3)) {
+            match = i;
+            break;
+        }
+        if (i < BUCKET_SIZE - 1 && entryWork(old) < minWork) {
+            replace = i;
+            minWork = entryWork(old);
+        }
+    }
+
+    // pinning the always replace entry moves it to the kept entry with the least work,
+    // unless every kept entry is pinned too
+    if (match == BUCKET_SIZE - 1 && work == PINNED_WORK && minWork < PINNED_WORK) {
+        __atomic_store_n(&bucket->entries[replace], data, __ATOMIC_RELAXED);
+        __atomic_store_n(&bucket->entries[match], 0, __ATOMIC_RELAXED);
+        return STORE_UPDATE;
+    }
+    if (match >= 0) {
+        __atomic_store_n(&bucket->entries[match], data, __ATOMIC_RELAXED);
+        return STORE_UPDATE;
+    }
+
+    // results cheaper than every kept entry go to the always replace entry, a pinned one is kept
+    if (minWork > work) {
+        unsigned long long last = __atomic_load_n(&bucket->entries[BUCKET_SIZE - 1], __ATOMIC_RELAXED);
+        if (((last >> ENTRY_FLAG_SHIFT) & 0x3) && entryWork(last) == PINNED_WORK)
+            return STORE_DROP;
+        replace = BUCKET_SIZE - 1;
+    }
+
+    unsigned long long old = __atomic_load_n(&bucket->entries[replace], __ATOMIC_RELAXED);
+    __atomic_store_n(&bucket->entries[replace], data, __ATOMIC_RELAXED);
+    return ((old >> ENTRY_FLAG_SHIFT) & 0x3) ? STORE_REPLACE : STORE_EMPTY;
+}
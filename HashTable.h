@@ -4,42 +4,64 @@
 #include <stdlib.h>
 
 // Constants
-#define HASH_TABLE_SIZE 64ull // in MB
+#define HASH_TABLE_SIZE 64ull // default size in MB
 #define MB_SIZE 1000000ull
+#define HUGE_PAGE_SIZE (2ull << 20)
+#define CLEAR_CHUNK (64ull << 20) // bytes cleared per thread when clearing in parallel
 
 #define FAIL_HIGH 1
 #define FAIL_LOW 2
 #define EXACT 3
 
-#define MT_STATE_SIZE 624
+// what addEntry did with the bucket
+#define STORE_EMPTY 0 // filled an empty entry
+#define STORE_UPDATE 1 // replaced the entry of the same position
+#define STORE_REPLACE 2 // evicted another position
+#define STORE_DROP 3 // dropped the entry, it was cheaper than every kept entry and the always replace entry is pinned
 
-// Random number generator (built-in is not good enough)
-typedef struct {
-    unsigned long long mt[MT_STATE_SIZE];
-    int index;
-} mt_state;
+#define PINNED_WORK 0x7f // the highest work, an entry stored with it is never evicted by another position
 
-void mt_init(mt_state *state, unsigned long long seed);
-unsigned long long mt_rand(mt_state *state);
+#define BUCKET_SIZE 8 // entries per bucket, 8 entries of 8 bytes fill a cache line
+#define CACHE_LINE 64
 
-// Hash table entry
+// Hash table entry as returned to the caller
 typedef struct {
-    unsigned long hash;
+    unsigned long long key;
     char value;
     char move;
     char flag;
+    char work;
 } Entry;
 
-// Hash table
+// A bucket of packed entries, each entry is one 64-bit word so it is read
+// and written atomically and the table needs no locks. From the low bits:
+// value (8), move (4), flag (2), work (7), partial key (43)
+// The first BUCKET_SIZE - 1 entries keep the entries with the most work
+// behind them, the last entry is always replaced unless it is pinned
+typedef struct {
+    unsigned long long entries[BUCKET_SIZE];
+} Bucket;
+
+// Hash table, the number of buckets is prime so the bucket index and
+// the partial key stored in the entry use different parts of the key.
+// Keys of the standard board are below 2^55, so with more than 2^12 buckets the bucket
+// and the partial key together identify the key exactly and entries never collide.
+// Keys of bigger boards need 2^(bits - 43) buckets to be exact
 typedef struct {
-    Entry* entries;
-    unsigned long* zobrist;
+    Bucket* buckets;
     unsigned long long size;
+    void* memory;
+    unsigned long long allocated; // bytes mapped at memory
+    int hugePages; // 2 explicit huge pages, 1 transparent huge pages, 0 normal pages
 } HashTable;
 
 HashTable* initHashTable();
+HashTable* initHashTableSize(unsigned long long sizeMB);
+void setHashTableSize(unsigned long long sizeMB);
 void freeHashTable(HashTable* table);
-Entry* getEntry(HashTable* table, unsigned long hash);
-void addEntry(HashTable* table, unsigned long hash, char value, char move, char flag);
+void clearHashTable(HashTable* table);
+void prefetchEntry(HashTable* table, unsigned long long key);
+int getEntry(HashTable* table, unsigned long long key, Entry* entry);
+int addEntry(HashTable* table, unsigned long long key, char value, char move, char flag, int work);
 
-#endif // HASHTABLE_H
\ No newline at end of file
+#endif // HASHTABLE_H
@@ -1,55 +1,36 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include "HashTable.h"
-
-#define HEIGHT 6
-#define WIDTH 7
-#define MAX_STONES 22
-#define MOVE_MASK 0b10000000100000001000000010000000100000001
-#define BOARD_MASK 0b11111110111111101111111011111110111111101111111
+#include "Main.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #define SELF_PLAY 0
 #define WEAK_SOLVER 0
 #define BOOK_COMPUTE_DEPTH 5
-#define BOOK_DIR "OpeningBook5"
+#define BOOK_DIR "OpeningBook5.bin"
 
-// A struct to hold the state of the board
-// the game board is 6 tall and 7 wide
-typedef struct {
-    unsigned long long p1;
-    unsigned long long p2;
-    unsigned long long nodes;
-    unsigned long hash;
-} BoardState;
+// number of threads used by solve, set with setThreadCount or -t on the command line
+static int threadCount = 1;
 
 void initBoard(BoardState* board) {
-    board->p1 = 0;
-    board->p2 = 0;
-    board->hash = 0;
+    board->position = 0;
+    board->mask = 0;
     board->nodes = 0;
 }
 
-BoardState* getInitBoard() {
-    BoardState* board = malloc(sizeof(BoardState));
-    initBoard(board);
-    return board;
-}
-
-void printBin(unsigned long long n) {
-    for (int i = 63; i >= 0; i--) {
-        printf("%lld", (n >> i) & 1);
+void printBin(bitboard n) {
+    for (int i = sizeof(bitboard) * 8 - 1; i >= 0; i--) {
+        printf("%d", (int)((n >> i) & 1));
     }
     printf("\n");
 }
 
 // print a binary board
-void printBinBoard(unsigned long long n) {
-    int index = 46;
+void printBinBoard(bitboard n) {
+    int index = (HEIGHT - 1) * (WIDTH + 1) + WIDTH - 1;
     for (int col = 0; col < HEIGHT; col++) {
         for (int row = 0; row < WIDTH; row++) {
-            printf("%lld", (n >> index) & 1);
+            printf("%d", (int)((n >> index) & 1));
             index--;
         }
         index--;
@@ -58,15 +39,18 @@ void printBinBoard(unsigned long long n) {
     printf("\n");
 }
 
-// print a human readable board
-void printBoard(BoardState board) {
-    int index = 46;
+// print a human readable board with player to move
+void printBoard(BoardState* board, int player) {
+    bitboard p1, p2;
+    getStones(board, player, &p1, &p2);
+
+    int index = (HEIGHT - 1) * (WIDTH + 1) + WIDTH - 1;
     for (int col = 0; col < HEIGHT; col++) {
         for (int row = 0; row < WIDTH; row++) {
-            if (board.p1 >> index & 1 == 1) {
+            if (p1 >> index & 1 == 1) {
                 printf("\033[0;34m O\033[0;37m");
             }
-            else if (board.p2 >> index & 1) {
+            else if (p2 >> index & 1) {
                 printf("\033[0;31m O\033[0;37m");
             }
             else {
@@ -80,6 +64,21 @@ void printBoard(BoardState board) {
     }
 }
 
+// wall clock time in seconds from an arbitrary start
+double getTime() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
 // get a valid move from the user
 int getMove() {
     int move;
@@ -109,58 +108,54 @@ HashTable* getInitTable() {
 }
 
 // converts the eval to moves to win 
-int convertEval(int eval, int player, BoardState* board) {
+int convertEval(int eval, BoardState* board) {
     if (eval == 0) {
         return 0;
     }
 
-    // use p1 stone count as a proxy for the number of moves played so far
-    int retVal = (eval > 0) ? (MAX_STONES - __builtin_popcountll((player) ? board->p2 : board->p1)) - eval
-                : -(MAX_STONES - __builtin_popcountll((player) ? board->p2 : board->p1)) - eval + 1;
+    // use the stone count of the player to move as a proxy for the number of moves played so far
+    int retVal = (eval > 0) ? (MAX_STONES - countStones(board->position)) - eval
+                : -(MAX_STONES - countStones(board->position)) - eval + 1;
     return retVal;
 }
 
-int findBookMove(char* bookDir, BoardState* board) {
-    // open the file
-    FILE* file = fopen(bookDir, "r");
-    if (file == NULL) {
-        printf("Error opening file\n");
-        return -1;
-    }
-
-    // for each line of the file check if the board matches
-    char line[100];
-    unsigned long long p1;
-    unsigned long long p2;
-    int move;
-    int eval;
-
-    while(fgets(line, sizeof(line), file)) {
-        // each line is 4 numbers seperated by spaces
-        sscanf(line, "%llu %llu %d %d", &p1, &p2, &move, &eval);
+// look up the stones of the player who moved first and those of the other player in the book,
+// the book is opened once and kept open for later calls
+int findBookMove(char* bookDir, bitboard first, bitboard second) {
+    static Book* book = NULL;
+    static char* openPath = NULL;
 
-        // check if the board matches inverted or not
-        if (board->p1 == p1 && board->p2 == p2) {
-            fclose(file);
-            return move;
-        }
-        else if (board->p1 == p2 && board->p2 == p1) {
-            fclose(file);
-            return move;
+    if (book == NULL || strcmp(openPath, bookDir) != 0) {
+        if (book != NULL) {
+            closeBook(book);
+            free(openPath);
         }
 
+        int error;
+        book = openBook(bookDir, &error);
+        if (book == NULL) {
+            openPath = NULL;
+            printf("Book %s %s\n", bookDir, bookError(error));
+            return -1;
+        }
+        openPath = strdup(bookDir);
     }
 
+    int move;
+    int eval;
+    if (probeBookStones(book, first, second, &move, &eval))
+        return move;
+
     return -1;
 }
 
 // return a bitmap of all the winning free spots making an alignment
-unsigned long long int computeWinningPosition(unsigned long long position, unsigned long long occupied) {
+bitboard computeWinningPosition(bitboard position, bitboard occupied) {
     // vertical
-    unsigned long long r = (position << (WIDTH + 1)) & (position << (2 * (WIDTH + 1))) & (position << (3 * (WIDTH + 1)));
+    bitboard r = (position << (WIDTH + 1)) & (position << (2 * (WIDTH + 1))) & (position << (3 * (WIDTH + 1)));
 
     // horizontal
-    unsigned long long p = (position << 1) & (position << 2);
+    bitboard p = (position << 1) & (position << 2);
     r |= p & (position << 3);
     r |= p & (position >> 1);
     p = (position >> 1) & (position >> 2);
@@ -186,51 +181,138 @@ unsigned long long int computeWinningPosition(unsigned long long position, unsig
     return r & ~occupied & BOARD_MASK;
 }
 
-// check if the board is in a winning state
-unsigned long long isAligned(BoardState* board, int player) {
-    unsigned long long playerPos = (player) ? board->p2 : board->p1;
-    unsigned long long occupied = board->p1 | board->p2;
-    unsigned long long winningMoves = computeWinningPosition(playerPos, occupied);
-
-    return winningMoves & playerPos;
+// check if the player who moved last has four in a row
+int isAligned(BoardState* board) {
+    return hasAlignment(board->position ^ board->mask);
 }
 
-void makeMove(BoardState* board, unsigned long long move, int player, HashTable* table) {
-    if (player) {
-        board->p2 = board->p2 ^ move;
-        board->hash = board->hash ^ table->zobrist[__builtin_ctzll(move) + 64];
-    }
-    else {
-        board->p1 = board->p1 ^ move;
-        board->hash = board->hash ^ table->zobrist[__builtin_ctzll(move)];
+// mirror the stones of a board left to right, also mirrors position keys
+bitboard mirrorBoard(bitboard stones) {
+#if WIDTH == 7 && !defined(BITBOARD_128)
+    // every row is a byte, its bits are reversed in place, leaving the unused top bit of the row at the bottom
+    stones = ((stones >> 1) & 0x5555555555555555ull) | ((stones & 0x5555555555555555ull) << 1);
+    stones = ((stones >> 2) & 0x3333333333333333ull) | ((stones & 0x3333333333333333ull) << 2);
+    stones = ((stones >> 4) & 0x0f0f0f0f0f0f0f0full) | ((stones & 0x0f0f0f0f0f0f0f0full) << 4);
+    return stones >> 1;
+#else
+    bitboard mirror = 0;
+    for (int col = 0; col < WIDTH; col++) {
+        mirror |= ((stones >> col) & KEY_COLUMN_MASK) << (WIDTH - 1 - col);
     }
+    return mirror;
+#endif
 }
 
-// generate the possible moves for this board state
-unsigned long long generateMoves(BoardState* board) {
-    unsigned long long filledPos = board->p1 | board->p2;
-    unsigned long long mask = 0b1111111ull;
-    unsigned long long moves = 0;
+// exact key of the position for the player to move: their stones plus a marker on the lowest
+// empty cell of every column (the row above the board for a full column). The highest bit of
+// each column is its marker and every cell below it is taken, so no two positions share a key
+bitboard positionKey(BoardState* board) {
+    bitboard marker = ((board->mask << (WIDTH + 1)) | BOTTOM_MASK) & ~board->mask;
+    return board->position | marker;
+}
 
-    for (int i = 0; i < 6; i++) {
-        moves = moves | ((filledPos ^ mask) & mask);
-        mask = (mask ^ moves) & mask;
-        mask = mask << 8;
+// keys of 128-bit boards are folded to the 64 bits the table stores, so unlike
+// the keys of smaller boards two positions can share an entry
+static inline unsigned long long foldKey(bitboard key) {
+#ifdef BITBOARD_128
+    return (unsigned long long)key ^ (unsigned long long)(key >> 64) * 0x9e3779b97f4a7c15ull;
+#else
+    return key;
+#endif
+}
 
-        if (mask == 0)
-            break;
-    }
+// the key the position is stored under, the smaller of its key and its mirror image's key
+unsigned long long tableKey(BoardState* board) {
+    bitboard key = positionKey(board);
+    bitboard mirrorKey = mirrorBoard(key);
+    return foldKey((mirrorKey < key) ? mirrorKey : key);
+}
+
+// a position and its mirror image share one table entry under the smaller of the two keys,
+// moves stored for the mirror image are mirrored on the way in and out
+int getBoardEntry(HashTable* table, BoardState* board, Entry* entry) {
+    bitboard key = positionKey(board);
+    bitboard mirrorKey = mirrorBoard(key);
+    int mirrored = mirrorKey < key;
+
+    if (!getEntry(table, foldKey((mirrored) ? mirrorKey : key), entry))
+        return 0;
+
+    if (mirrored && entry->move >= 0)
+        entry->move = WIDTH - 1 - entry->move;
+    return 1;
+}
+
+int addBoardEntry(HashTable* table, BoardState* board, char value, char move, char flag, int work) {
+    bitboard key = positionKey(board);
+    bitboard mirrorKey = mirrorBoard(key);
+    int mirrored = mirrorKey < key;
 
-    return moves;
+    if (mirrored && move >= 0)
+        move = WIDTH - 1 - move;
+    return addEntry(table, foldKey((mirrored) ? mirrorKey : key), value, move, flag, work);
+}
+
+// set up the board from the stones of each player with player 0 (p1) or 1 (p2) to move
+void setBoard(BoardState* board, bitboard p1, bitboard p2, int player) {
+    initBoard(board);
+    board->position = (player) ? p2 : p1;
+    board->mask = p1 | p2;
+}
+
+// the stones of each player of a board with player to move
+void getStones(BoardState* board, int player, bitboard* p1, bitboard* p2) {
+    bitboard opponent = board->position ^ board->mask;
+    *p1 = (player) ? opponent : board->position;
+    *p2 = (player) ? board->position : opponent;
+}
+
+// the stones of the player who moved first and those of the other player, the first player
+// is to move after an even number of stones
+void getFirstStones(BoardState* board, bitboard* first, bitboard* second) {
+    getStones(board, countStones(board->mask) & 1, first, second);
+}
+
+// play a move (the lowest empty cell of a column), the opponent is to move after it
+void makeMove(BoardState* board, bitboard move) {
+    board->position ^= board->mask;
+    board->mask |= move;
+}
+
+// take back the last move
+void undoMove(BoardState* board, bitboard move) {
+    board->mask ^= move;
+    board->position ^= board->mask;
+}
+
+// play in a column, returns the cell played or 0 if the column is full (the board is then unchanged)
+bitboard playColumn(BoardState* board, int col) {
+    bitboard move = generateMoves(board) & (MOVE_MASK << col);
+    if (move)
+        makeMove(board, move);
+    return move;
+}
+
+// generate the possible moves for this board state, the lowest empty cell of every column that isn't full.
+// Columns are bits of different rows here, so the cell above the top stone is the mask shifted up a row
+bitboard generateMoves(BoardState* board) {
+    return ((board->mask << (WIDTH + 1)) | BOTTOM_MASK) & ~board->mask & BOARD_MASK;
+}
+
+// the columns from the center out, the order the search tries them in before sorting
+void centerOrder(char order[WIDTH]) {
+    for (int i = 0; i < WIDTH; i++) {
+        order[i] = (i & 1) ? WIDTH / 2 - (i + 1) / 2 : WIDTH / 2 + i / 2;
+    }
 }
 
 // returns a board mask of the moves that don't lose the game immediately
-unsigned long long getNonLosingMove(BoardState* board, unsigned long long moves, int player) {
-    unsigned long long opponentWinningPos = computeWinningPosition((player) ? board->p1 : board->p2, board->p1 | board->p2);
-    unsigned long long opponentWinningMoves = opponentWinningPos & moves;
+bitboard getNonLosingMove(BoardState* board, bitboard moves) {
+    bitboard opponentWinningPos = computeWinningPosition(board->position ^ board->mask, board->mask);
+    bitboard opponentWinningMoves = opponentWinningPos & moves;
 
     // there is nothing to do this position is lost since there are two winning moves for the opponent
-    if (__builtin_popcountll(opponentWinningMoves) > 1)
+    if (opponentWinningMoves & (opponentWinningMoves - 1))
         return 0;
     else if (!opponentWinningMoves)
         opponentWinningMoves = moves;
@@ -239,126 +321,320 @@ unsigned long long getNonLosingMove(BoardState* board, unsigned long long moves,
     return opponentWinningMoves & ~(opponentWinningPos >> (WIDTH + 1));
 }
 
-// insertion sort the arrays 
-void sortArray(char* sortArray, char* valArray, int size) {
-    for (int i = 1; i < size; i++) {
-        char keySort = sortArray[i];
-        char keyVal = valArray[i];
-        int j = i - 1;
+// check if the stones hold four in a row, the unused top bit of every row stops rows from wrapping
+int hasAlignment(bitboard stones) {
+    bitboard pairs = stones & (stones >> (WIDTH + 1));
+    if (pairs & (pairs >> (2 * (WIDTH + 1))))
+        return 1;
 
-        while (j >= 0 && sortArray[j] < keySort) {
-            sortArray[j + 1] = sortArray[j];
-            valArray[j + 1] = valArray[j];
-            j--;
-        }
+    pairs = stones & (stones >> 1);
+    if (pairs & (pairs >> 2))
+        return 1;
+
+    pairs = stones & (stones >> WIDTH);
+    if (pairs & (pairs >> (2 * WIDTH)))
+        return 1;
+
+    pairs = stones & (stones >> (WIDTH + 2));
+    return (pairs & (pairs >> (2 * (WIDTH + 2)))) != 0;
+}
 
-        sortArray[j + 1] = keySort;
-        valArray[j + 1] = keyVal;
+// the empty cells an even number of rows above the lowest empty cell of their column
+static inline bitboard oddCells(bitboard lowest, bitboard empty) {
+    bitboard odd = lowest;
+    for (int row = 2; row < HEIGHT; row += 2) {
+        odd |= lowest << (row * (WIDTH + 1));
     }
+    return odd & empty;
+}
+
+// upper bound on the score of the player to move when every column has an even number of empty cells,
+// MAX_STONES otherwise. The opponent can then answer every move on top of it (follow up) and gets every
+// second empty cell of each column. If the player has no four with the rest of the cells they can't win,
+// and if the opponent then has a four with their cells they win by the time the board is full
+static int followUpBound(bitboard playerPos, bitboard opponentPos) {
+    bitboard occupied = playerPos | opponentPos;
+    bitboard empty = BOARD_MASK & ~occupied;
+    bitboard lowest = ((occupied << (WIDTH + 1)) | BOTTOM_MASK) & empty;
+    bitboard odd = oddCells(lowest, empty);
+    bitboard even = empty & ~odd;
+
+    // a column with an odd number of empty cells has its top cell on an odd row
+    if ((odd & TOP_MASK) || hasAlignment(playerPos | odd))
+        return MAX_STONES;
+
+    if (hasAlignment(opponentPos | even))
+        return -(MAX_STONES - countStones(opponentPos | even));
+    return 0;
 }
 
-// sort the moves by the number of winning positions they create
-// use insertion sort as the list is small and mostly sorted
-int sortMoves(BoardState* board, unsigned long long moves, char order[], int player, Entry* entry) {
-    char score[WIDTH];
-    unsigned long long moveMasker = MOVE_MASK;
-    unsigned long long playerPos = (player) ? board->p2 : board->p1;
-    unsigned long long occupied = board->p1 | board->p2;
-    unsigned long long move;
+// bounds on the score of the player to move from the parity of the empty cells
+// with every column even the opponent may have a follow up, with one odd column the
+// player can make every column even by playing there and may have one themselves.
+// Returns the column of that move when it proves the lower bound, -1 otherwise
+int parityBounds(BoardState* board, int* lower, int* upper) {
+    bitboard playerPos = board->position;
+    bitboard opponentPos = board->position ^ board->mask;
+    bitboard occupied = board->mask;
+    bitboard empty = BOARD_MASK & ~occupied;
+    bitboard lowest = ((occupied << (WIDTH + 1)) | BOTTOM_MASK) & empty;
+    bitboard odd = oddCells(lowest, empty);
+
+    *lower = -MAX_STONES;
+    *upper = MAX_STONES;
+
+    bitboard oddColumns = odd & TOP_MASK;
+    if (!oddColumns) {
+        *upper = followUpBound(playerPos, opponentPos);
+    }
+    else if (!(oddColumns & (oddColumns - 1))) {
+        int column = lowestBit(oddColumns) % (WIDTH + 1);
+        int bound = followUpBound(opponentPos, playerPos | (lowest & (MOVE_MASK << column)));
+        if (bound < MAX_STONES) {
+            *lower = -bound;
+            return column;
+        }
+    }
+    return -1;
+}
+
+// compare and swap for the ordering network, the larger key goes first
+#define ORDER_SWAP(key, a, b) {                             \
+    int hi = (key[a] > key[b]) ? key[a] : key[b];           \
+    int lo = (key[a] > key[b]) ? key[b] : key[a];           \
+    key[a] = hi;                                            \
+    key[b] = lo;                                            \
+}
+
+// sort the WIDTH keys in descending order with a fixed network of compare and swaps for the board width
+// (16 for 7 columns), unlike a sort loop it has no data dependent branches
+static inline void orderNetwork(int key[WIDTH]) {
+#if WIDTH == 4
+    ORDER_SWAP(key, 0, 1); ORDER_SWAP(key, 2, 3);
+    ORDER_SWAP(key, 0, 2); ORDER_SWAP(key, 1, 3);
+    ORDER_SWAP(key, 1, 2);
+#elif WIDTH == 5
+    ORDER_SWAP(key, 0, 3); ORDER_SWAP(key, 1, 4);
+    ORDER_SWAP(key, 0, 2); ORDER_SWAP(key, 1, 3);
+    ORDER_SWAP(key, 0, 1); ORDER_SWAP(key, 2, 4);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 3, 4);
+    ORDER_SWAP(key, 2, 3);
+#elif WIDTH == 6
+    ORDER_SWAP(key, 0, 5); ORDER_SWAP(key, 1, 3); ORDER_SWAP(key, 2, 4);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 3, 4);
+    ORDER_SWAP(key, 0, 3); ORDER_SWAP(key, 2, 5);
+    ORDER_SWAP(key, 0, 1); ORDER_SWAP(key, 2, 3); ORDER_SWAP(key, 4, 5);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 3, 4);
+#elif WIDTH == 7
+    ORDER_SWAP(key, 0, 6); ORDER_SWAP(key, 2, 3); ORDER_SWAP(key, 4, 5);
+    ORDER_SWAP(key, 0, 2); ORDER_SWAP(key, 1, 4); ORDER_SWAP(key, 3, 6);
+    ORDER_SWAP(key, 0, 1); ORDER_SWAP(key, 2, 5); ORDER_SWAP(key, 3, 4);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 4, 6);
+    ORDER_SWAP(key, 2, 3); ORDER_SWAP(key, 4, 5);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 3, 4); ORDER_SWAP(key, 5, 6);
+#elif WIDTH == 8
+    ORDER_SWAP(key, 0, 2); ORDER_SWAP(key, 1, 3); ORDER_SWAP(key, 4, 6); ORDER_SWAP(key, 5, 7);
+    ORDER_SWAP(key, 0, 4); ORDER_SWAP(key, 1, 5); ORDER_SWAP(key, 2, 6); ORDER_SWAP(key, 3, 7);
+    ORDER_SWAP(key, 0, 1); ORDER_SWAP(key, 2, 3); ORDER_SWAP(key, 4, 5); ORDER_SWAP(key, 6, 7);
+    ORDER_SWAP(key, 2, 4); ORDER_SWAP(key, 3, 5);
+    ORDER_SWAP(key, 1, 4); ORDER_SWAP(key, 3, 6);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 3, 4); ORDER_SWAP(key, 5, 6);
+#else
+    ORDER_SWAP(key, 0, 3); ORDER_SWAP(key, 1, 7); ORDER_SWAP(key, 2, 5); ORDER_SWAP(key, 4, 8);
+    ORDER_SWAP(key, 0, 7); ORDER_SWAP(key, 2, 4); ORDER_SWAP(key, 3, 8); ORDER_SWAP(key, 5, 6);
+    ORDER_SWAP(key, 0, 2); ORDER_SWAP(key, 1, 3); ORDER_SWAP(key, 4, 5); ORDER_SWAP(key, 7, 8);
+    ORDER_SWAP(key, 1, 4); ORDER_SWAP(key, 3, 6); ORDER_SWAP(key, 5, 7);
+    ORDER_SWAP(key, 0, 1); ORDER_SWAP(key, 2, 4); ORDER_SWAP(key, 3, 5); ORDER_SWAP(key, 6, 8);
+    ORDER_SWAP(key, 2, 3); ORDER_SWAP(key, 4, 5); ORDER_SWAP(key, 6, 7);
+    ORDER_SWAP(key, 1, 2); ORDER_SWAP(key, 3, 4); ORDER_SWAP(key, 5, 6);
+#endif
+}
+
+// sort the moves by the number of winning positions they create, ties keep the order they had
+// every candidate is scored at once by scoreMoves, the key holds the score above the position
+// in order so the network sorts like a stable sort
+int sortMoves(BoardState* board, bitboard moves, char order[], Entry* entry) {
+    bitboard candidates[MOVE_LANES] = { 0 };
+    char score[MOVE_LANES];
+    char original[WIDTH];
+    int key[WIDTH];
     int index = WIDTH;
-    
+
     for (int i = 0; i < WIDTH; i++) {
-        move = ((moveMasker << order[i]) & moves);
+        candidates[i] = (MOVE_MASK << order[i]) & moves;
+    }
 
-        if (!move) {
-            score[i] = -10;
+    // get a count of winning oprotunities for each move this is the default score
+    scoreMoves(board->position, board->mask, candidates, score);
+
+    for (int i = 0; i < WIDTH; i++) {
+        int value = score[i];
+
+        if (!candidates[i]) {
+            value = -10;
             index--;
-            continue;
         }
-
         // check if this is the transposition table move
-        if (entry != 0 && entry->move == order[i]) {
-            score[i] = 10;
-            continue;
+        else if (entry != 0 && entry->move == order[i]) {
+            value = 10;
         }
 
-        // get a count of winning oprotunities for each move this is the default score
-        score[i] = __builtin_popcountll(computeWinningPosition(playerPos | move, occupied | move));
+        key[i] = value * 16 + (WIDTH - 1 - i);
     }
 
-    sortArray(score, order, WIDTH);
+    orderNetwork(key);
+
+    memcpy(original, order, WIDTH);
+    for (int i = 0; i < WIDTH; i++) {
+        order[i] = original[WIDTH - 1 - (key[i] & 15)];
+    }
 
     return index;
 }
 
-int negamax(BoardState* board, int player, int alpha, int beta, HashTable* table) {
+int negamax(BoardState* board, int alpha, int beta, SearchThread* thread) {
+    HashTable* table = thread->table;
     int bestEval = -100;
     int alphaOrig = alpha;
     int bestMove = -1;
-    board->nodes++;
+    unsigned long long startNodes = board->nodes++;
+    STAT_ADD(&thread->stats, nodes, 1);
+    STAT_ADD(&thread->stats, nodesByPly[countStones(board->mask)], 1);
+
+    // check the clock and the cancel flag every few thousand nodes, running out of time or a cancel stops every thread
+    if ((board->nodes & DEADLINE_CHECK_NODES) == 0
+        && ((thread->deadline > 0 && getTime() >= thread->deadline) || (thread->cancel != NULL && *thread->cancel)))
+        *thread->stop = 1;
 
     // generate moves 
-    unsigned long long moves = generateMoves(board);
+    bitboard moves = generateMoves(board);
 
     // check for a draw
     if (!moves)
         return 0;
 
     // get non losing moves
-    unsigned long long nonLossingMoves = getNonLosingMove(board, moves, player);
+    bitboard nonLossingMoves = getNonLosingMove(board, moves);
 
     // there are no moves that don't lose the game immediately
     // return the score for the opponent winning in the next move
     if (!nonLossingMoves) {
-        int score = -(MAX_STONES - (__builtin_popcountll((player) ? board->p1 : board->p2) + 1));
-        addEntry(table, board->hash, score, __builtin_ctzll(moves) % (WIDTH + 1), EXACT);
+        int score = -(MAX_STONES - (countStones(board->position ^ board->mask) + 1));
+        STAT_ADD(&thread->stats, forcedLosses, 1);
+        STAT_STORE(&thread->stats, addBoardEntry(table, board, score, lowestBit(moves) % (WIDTH + 1), EXACT, 0));
         return score;
     }
+    STAT_ADD(&thread->stats, prunedMoves, countStones(moves) - countStones(nonLossingMoves));
 
     // get an upper bound on the board, since we can't win immediately
-    int max = MAX_STONES - (__builtin_popcountll((player) ? board->p2 : board->p1) + 2);
+    int max = MAX_STONES - (countStones(board->position) + 2);
     // keeping beta below the max possible value increases the chance of a cutoff
     if (beta > max)
         beta = max;
 
     // check if the board is in the table
-    Entry* entry = getEntry(table, board->hash);
+    Entry tableEntry;
+    Entry* entry = getBoardEntry(table, board, &tableEntry) ? &tableEntry : 0;
+    thread->probes++;
+    STAT_ADD(&thread->stats, probes, 1);
     if (entry != 0) {
+        thread->hits++;
+        STAT_ADD(&thread->stats, hits, 1);
         if (entry->flag == EXACT) {
+            STAT_ADD(&thread->stats, exactHits, 1);
             return entry->value;
         }
         else if (entry->flag == FAIL_LOW) {
             beta = (beta < entry->value) ? beta : entry->value;
         }
         else if (entry->flag == FAIL_HIGH) {
-            alpha = (alpha < entry->value) ? alpha : entry->value;
+            alpha = (alpha > entry->value) ? alpha : entry->value;
         }
     }
 
+    STAT_ADD(&thread->stats, tableCutoffs, alpha >= beta);
+
+    // the parity of the empty cells can prove who holds the draw or the win
+    int lower, upper;
+    int parityMove = parityBounds(board, &lower, &upper);
+    if (beta > upper)
+        beta = upper;
+    if (alpha < lower) {
+        // the move proving the bound is kept unless a search finds a better one
+        alpha = lower;
+        bestEval = lower;
+        bestMove = parityMove;
+    }
+
     // check for a cutoff
-    if (alpha >= beta)
+    if (alpha >= beta) {
+        STAT_ADD(&thread->stats, boundCutoffs, 1);
+
+        // a fail high at the root reads the move from the table, so store the move that proves it
+        if (lower >= beta)
+            STAT_STORE(&thread->stats, addBoardEntry(table, board, lower, parityMove, FAIL_HIGH, 0));
         return beta;
+    }
 
-    unsigned long long move;
+    bitboard move;
     int eval;
 
+    // enhanced transposition cutoffs, far from the end of the game look up the children before
+    // searching any of them. The child buckets are prefetched together and loaded while the moves are sorted
+    unsigned long long childKeys[WIDTH];
+    char childMoves[WIDTH];
+    int childCount = 0;
+    int checkChildren = HEIGHT * WIDTH - countStones(board->mask) >= ETC_MIN_EMPTY;
+    if (checkChildren) {
+        for (bitboard moveSet = nonLossingMoves; moveSet; moveSet &= moveSet - 1) {
+            move = moveSet & -moveSet;
+            makeMove(board, move);
+            childKeys[childCount] = tableKey(board);
+            childMoves[childCount] = lowestBit(move) % (WIDTH + 1);
+            undoMove(board, move);
+            prefetchEntry(table, childKeys[childCount++]);
+        }
+    }
+
     // explore the middle columns first as they are more likely to be good moves
-    char exploreOrder[] = { 3, 2, 4, 1, 5, 0, 6 };
+    // (each thread has its own variation of this order)
+    char exploreOrder[WIDTH];
+    memcpy(exploreOrder, thread->order, WIDTH);
 
     // sort by the number of winning positions they create and 
     // don't explore the losing moves
-    int losingStart = sortMoves(board, nonLossingMoves, exploreOrder, player, entry);
+    int losingStart = sortMoves(board, nonLossingMoves, exploreOrder, entry);
+
+    // a child whose score is known to be low enough proves the node fails high without a search
+    for (int i = 0; i < childCount; i++) {
+        Entry child;
+        thread->probes++;
+        STAT_ADD(&thread->stats, childProbes, 1);
+        if (!getEntry(table, childKeys[i], &child))
+            continue;
+
+        thread->hits++;
+        STAT_ADD(&thread->stats, childHits, 1);
+        if ((child.flag == FAIL_LOW || child.flag == EXACT) && -child.value >= beta) {
+            STAT_ADD(&thread->stats, childCutoffs, 1);
+            STAT_STORE(&thread->stats, addBoardEntry(table, board, -child.value, childMoves[i], FAIL_HIGH, 0));
+            return beta;
+        }
+    }
 
     // loop through moves until there are no more or a cutoff occures
     for (int i = 0; i < losingStart; i++) {
         move = moves & (MOVE_MASK << exploreOrder[i]);
 
-        makeMove(board, move, player, table);
+        makeMove(board, move);
 
-        eval = -negamax(board, !player, -beta, -alpha, table);
+        eval = -negamax(board, -beta, -alpha, thread);
 
-        // make move is reversible
-        makeMove(board, move, player, table);
+        undoMove(board, move);
+
+        // another thread finished the search, unwind without touching the table
+        if (*thread->stop)
+            return 0;
 
         // alpha beta prunning
         if (bestEval < eval) {
@@ -367,9 +643,11 @@ int negamax(BoardState* board, int player, int alpha, int beta, HashTable* table
         }
         alpha = (eval < alpha) ? alpha : bestEval;
         if (alpha >= beta) {
+            STAT_ADD(&thread->stats, betaCutoffs[i], 1);
             break;
         }
     }
+    STAT_ADD(&thread->stats, allNodes, alpha < beta);
 
     // set the transposition table flags
     char flag;
@@ -381,32 +659,27 @@ int negamax(BoardState* board, int player, int alpha, int beta, HashTable* table
         flag = EXACT;
 
 
-    addEntry(table, board->hash, bestEval, bestMove, flag);
+    // the log2 of the subtree size, so expensive results are kept over cheap ones
+    int work = 64 - __builtin_clzll(board->nodes - startNodes);
+    STAT_STORE(&thread->stats, addBoardEntry(table, board, bestEval, bestMove, flag, work));
 
     return alpha;
 }
 
-// solve the board
-int solve(BoardState* board, int player, HashTable* table, int weak) {
-    clock_t start = clock();
-    board->nodes = 0;
+// run the null window binary search for the root position of a thread
+// the bounds proven so far and the move that proved the lower bound are kept in the thread
+int searchRoot(SearchThread* thread) {
+    BoardState* board = &thread->board;
     int eval = 0;
+    Entry root;
+    int step = 1; // distance of the next probe from the bound a widening probe failed on
+    int direction = 0; // the side the last widening probe failed on, 1 high, -1 low
 
-    // quickly check if there is a winning move (negmax never explores these since it detects wins one move ahead)
-    unsigned long long moves = generateMoves(board);
-    unsigned long long winningMoves = computeWinningPosition((player) ? board->p2 : board->p1, board->p1 | board->p2);
-    if (winningMoves & moves) {
-        int score = MAX_STONES - (__builtin_popcountll((player) ? board->p2 : board->p1) + 1);
-        char move =  __builtin_ctzll(winningMoves & moves) % (WIDTH + 1);
-        addEntry(table, board->hash, score, move, EXACT);
-        return score;
-    }
-
-    // min and max values from the current state
-    int min = -(MAX_STONES - __builtin_popcountll(board->p1)); 
-    int max = MAX_STONES - __builtin_popcountll(board->p1);
+    // min and max values from the current state, from the stones the first player has placed
+    int min = -(MAX_STONES - (countStones(board->mask) + 1) / 2);
+    int max = MAX_STONES - (countStones(board->mask) + 1) / 2;
 
-    if (weak) {
+    if (thread->weak) {
         min = -1;
         max = 1;
     }
@@ -418,18 +691,422 @@ int solve(BoardState* board, int player, HashTable* table, int weak) {
         else if(med >= 0 && max / 2 > med)
             med = max / 2;
 
+        // a caller that expects the score near a value tests it first
+        int widening = 0;
+        if (thread->guess >= min && thread->guess < max) {
+            med = thread->guess;
+            thread->guess = NO_GUESS;
+            widening = thread->widen;
+        }
+
         // use a null depth window search
-        eval = negamax(board, player, med, med + 1, table);
+        eval = negamax(board, med, med + 1, thread);
+        STAT_ADD(&thread->stats, iterations, 1);
+
+        if (*thread->stop)
+            return 0;
 
         if(eval <= med)
             max = eval;
-        else 
+        else {
             min = eval;
+
+            // a fail high at the root proves the stored move reaches at least the new lower bound
+            // (another thread may have stored a lower one since)
+            if (getBoardEntry(thread->table, board, &root) && (root.flag == FAIL_HIGH || root.flag == EXACT)
+                && root.value >= min && root.move >= 0)
+                thread->bestMove = root.move;
+        }
+        thread->lower = min;
+        thread->upper = max;
+
+        // widen away from the guess on the side it failed, twice as far each time, until
+        // probes have failed on both sides and the binary search finishes between them
+        if (widening) {
+            int failed = (eval <= med) ? -1 : 1;
+            if (direction == 0 || direction == failed) {
+                thread->guess = (failed < 0) ? max - step : min + step - 1;
+                step *= 2;
+            }
+            direction = failed;
+        }
+    }
+
+    thread->complete = 1;
+    return eval;
+}
+
+// entry point of a search thread, the first thread to finish the root search wins
+static void* searchWorker(void* arg) {
+    SearchThread* thread = (SearchThread*)arg;
+    int eval = searchRoot(thread);
+    int none = -1;
+
+    if (thread->complete && __atomic_compare_exchange_n(thread->winner, &none, thread->id, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        thread->eval = eval;
+
+        // keep the root entry of the winning search, helpers may still overwrite it before they stop
+        if (!getBoardEntry(thread->table, &thread->board, &thread->root))
+            thread->root.flag = 0;
+
+        *thread->stop = 1;
+    }
+
+    return NULL;
+}
+
+void setThreadCount(int threads) {
+    if (threads < 1)
+        threads = 1;
+    else if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    threadCount = threads;
+}
+
+int getThreadCount() {
+    return threadCount;
+}
+
+// the outcome for the player to move given the bounds on the score
+static int getOutcome(int lower, int upper) {
+    if (lower > 0)
+        return OUTCOME_WIN;
+    if (upper < 0)
+        return OUTCOME_LOSS;
+    if (lower >= 0 && upper <= 0)
+        return OUTCOME_DRAW;
+    return OUTCOME_UNKNOWN;
+}
+
+// the move to play when no search proved one, such as when the search ran out of time before
+// proving a lower bound at the root. The board must have a legal move
+char fallbackMove(BoardState* board, HashTable* table) {
+    bitboard moves = generateMoves(board);
+    Entry entry;
+
+    if (getBoardEntry(table, board, &entry) && entry.move >= 0 && (moves & (MOVE_MASK << entry.move)))
+        return entry.move;
+
+    // otherwise the first move the search would have tried
+    char order[WIDTH];
+    centerOrder(order);
+    bitboard nonLosingMoves = getNonLosingMove(board, moves);
+    sortMoves(board, nonLosingMoves ? nonLosingMoves : moves, order, 0);
+    return order[0];
+}
+
+// solve the board, the first window of the search tests guess unless it is NO_GUESS
+static int solveGuess(BoardState* board, HashTable* table, int weak, int threadCount, double timeLimit, int guess,
+                      int widen, volatile int* cancel, SolveResult* result) {
+    double deadline = (timeLimit > 0) ? getTime() + timeLimit : 0;
+    board->nodes = 0;
+    result->nodes = 0;
+    result->probes = 0;
+    result->hits = 0;
+    result->complete = 1;
+#if SEARCH_STATS
+    memset(&result->stats, 0, sizeof(SearchStats));
+#endif
+    STAT_ADD(&result->stats, solves, 1);
+    int eval = 0;
+
+    // quickly check if there is a winning move (negmax never explores these since it detects wins one move ahead)
+    bitboard moves = generateMoves(board);
+    bitboard winningMoves = computeWinningPosition(board->position, board->mask);
+    if (winningMoves & moves) {
+        int score = MAX_STONES - (countStones(board->position) + 1);
+        char move =  lowestBit(winningMoves & moves) % (WIDTH + 1);
+        addBoardEntry(table, board, score, move, EXACT, 0);
+        result->eval = score;
+        result->move = move;
+        result->lower = score;
+        result->upper = score;
+        result->outcome = getOutcome(score, score);
+        return score;
+    }
+
+    // every thread searches the same root, helpers use a slightly different
+    // column order so they fill the table with different parts of the tree
+    char baseOrder[WIDTH];
+    centerOrder(baseOrder);
+    SearchThread threads[MAX_THREADS];
+    pthread_t handles[MAX_THREADS];
+    volatile int stop = 0;
+    int winner = -1;
+
+    for (int i = 0; i < threadCount; i++) {
+        SearchThread* thread = &threads[i];
+        thread->board = *board;
+        thread->table = table;
+        thread->weak = weak;
+        thread->id = i;
+        thread->stop = &stop;
+        thread->winner = &winner;
+        thread->probes = 0;
+        thread->hits = 0;
+#if SEARCH_STATS
+        memset(&thread->stats, 0, sizeof(SearchStats));
+#endif
+        thread->deadline = deadline;
+        thread->cancel = cancel;
+        thread->lower = -MAX_STONES;
+        thread->upper = MAX_STONES;
+        thread->bestMove = -1;
+        thread->complete = 0;
+        thread->guess = guess;
+        thread->widen = widen;
+        memcpy(thread->order, baseOrder, WIDTH);
+
+        if (i > 0) {
+            int swap = (i - 1) % (WIDTH - 1);
+            char tmp = thread->order[swap];
+            thread->order[swap] = thread->order[swap + 1];
+            thread->order[swap + 1] = tmp;
+        }
+    }
+
+    for (int i = 1; i < threadCount; i++) {
+        pthread_create(&handles[i], NULL, searchWorker, &threads[i]);
+    }
+    searchWorker(&threads[0]);
+    for (int i = 1; i < threadCount; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        board->nodes += threads[i].board.nodes;
+        result->probes += threads[i].probes;
+        result->hits += threads[i].hits;
+#if SEARCH_STATS
+        mergeStats(&result->stats, &threads[i].stats);
+#endif
+    }
+    result->nodes = board->nodes;
+
+    if (winner >= 0) {
+        eval = threads[winner].eval;
+        result->eval = eval;
+        result->lower = eval;
+        result->upper = eval;
+        result->outcome = getOutcome(eval, eval);
+
+        // the move of the last fail high reaches the score, without one the score is the lowest
+        // possible and every move reaches it
+        result->move = threads[winner].bestMove;
+        if (threads[winner].root.flag) {
+            Entry* root = &threads[winner].root;
+            addBoardEntry(table, board, root->value, root->move, root->flag, root->work);
+        }
+        if (result->move < 0)
+            result->move = fallbackMove(board, table);
+        return eval;
+    }
+
+    // out of time, every thread's bounds hold so combine them and keep the move behind the best lower bound
+    result->complete = 0;
+    result->lower = threads[0].lower;
+    result->upper = threads[0].upper;
+    result->move = threads[0].bestMove;
+    for (int i = 1; i < threadCount; i++) {
+        if (threads[i].lower > result->lower && threads[i].bestMove >= 0) {
+            result->lower = threads[i].lower;
+            result->move = threads[i].bestMove;
+        }
+        if (threads[i].upper < result->upper)
+            result->upper = threads[i].upper;
+    }
+    if (result->move < 0)
+        result->move = fallbackMove(board, table);
+
+    result->outcome = getOutcome(result->lower, result->upper);
+    result->eval = (result->outcome == OUTCOME_UNKNOWN) ? 0 : result->lower;
+    return result->eval;
+}
+
+// solve the board with the given number of threads without printing anything
+// with a time limit (in seconds, 0 for none) the search stops when it runs out and the result
+// holds the bounds proven so far and the best move found, the table keeps the finished subtrees
+// for the next call
+int solvePosition(BoardState* board, HashTable* table, int weak, int threadCount, double timeLimit, SolveResult* result) {
+    return solveGuess(board, table, weak, threadCount, timeLimit, NO_GUESS, 0, NULL, result);
+}
+
+// solve the board without a time limit until it is done or another thread sets *cancel, a cancelled
+// solve returns like one that ran out of time and the table keeps what it found
+int solveCancellable(BoardState* board, HashTable* table, int weak, int threadCount, volatile int* cancel, SolveResult* result) {
+    return solveGuess(board, table, weak, threadCount, 0, NO_GUESS, 0, cancel, result);
+}
+
+void initSession(GameSession* session, HashTable* table) {
+    session->table = table;
+    session->valid = 0;
+    session->pvLength = 0;
+}
+
+// forget the last solve and give the pinned entries their work back, an entry that was
+// replaced by a search of the same position since is left alone
+void endSession(GameSession* session) {
+    Entry entry;
+
+    for (int i = 0; i < session->pvLength; i++) {
+        if (getBoardEntry(session->table, &session->pv[i], &entry) && entry.work == PV_WORK)
+            addBoardEntry(session->table, &session->pv[i], entry.value, entry.move, entry.flag, session->pvWork[i]);
+    }
+
+    session->valid = 0;
+    session->pvLength = 0;
+}
+
+// remember the exact score of a position of the game and pin the principal variation the table holds for it
+void updateSession(GameSession* session, BoardState* board, int weak, int score) {
+    BoardState position = *board;
+    Entry entry;
+
+    endSession(session);
+    session->board = *board;
+    session->weak = weak;
+    session->score = score;
+    session->valid = 1;
+
+    while (session->pvLength < WIDTH * HEIGHT && getBoardEntry(session->table, &position, &entry) && entry.move >= 0) {
+        bitboard move = generateMoves(&position) & (MOVE_MASK << entry.move);
+        if (!move)
+            break;
+
+        session->pv[session->pvLength] = position;
+        session->pvWork[session->pvLength] = entry.work;
+        session->pvLength++;
+        addBoardEntry(session->table, &position, entry.value, entry.move, entry.flag, PV_WORK);
+
+        makeMove(&position, move);
+        if (isAligned(&position))
+            break;
     }
+}
+
+// solve a position of the session's game, a position reached from the last one solved is expected to
+// keep its score (for the same player to move) so the search tests that first and widens from there
+int solveSession(GameSession* session, BoardState* board, int weak, int threadCount, double timeLimit, SolveResult* result) {
+    int guess = NO_GUESS;
+    BoardState* last = &session->board;
+    int swapped = (countStones(board->mask) - countStones(last->mask)) & 1;
+
+    // the stones of the player to move in the last position are those of the same player here
+    bitboard same = (swapped) ? board->position ^ board->mask : board->position;
+    if (session->valid && session->weak == weak
+        && !(last->position & ~same) && !((last->position ^ last->mask) & ~(board->mask ^ same)))
+        guess = (swapped) ? -session->score : session->score;
+
+    int eval = solveGuess(board, session->table, weak, threadCount, timeLimit, guess, 1, NULL, result);
+    if (result->complete)
+        updateSession(session, board, weak, eval);
+    return eval;
+}
+
+// Columns of an analysis are handed to the threads one at a time, the best score so far is shared
+typedef struct {
+    BoardState* board;
+    HashTable* table;
+    int weak;
+    int next;
+    int best;
+    int* scores;
+    unsigned long long nodes;
+} Analysis;
+
+static void* analysisWorker(void* arg) {
+    Analysis* analysis = (Analysis*)arg;
+    bitboard moves = generateMoves(analysis->board);
+    SolveResult result;
+    char columnOrder[WIDTH];
+    centerOrder(columnOrder);
+
+    while (1) {
+        int i = __atomic_fetch_add(&analysis->next, 1, __ATOMIC_RELAXED);
+        if (i >= WIDTH)
+            break;
+
+        int col = columnOrder[i];
+        bitboard move = moves & (MOVE_MASK << col);
+        if (!move) {
+            analysis->scores[col] = NO_SCORE;
+            continue;
+        }
+
+        BoardState child = *analysis->board;
+        makeMove(&child, move);
+        int score;
 
-    printf("Eval: %d\n", convertEval(eval, player, board));
+        if (isAligned(&child)) {
+            score = MAX_STONES - countStones(child.position ^ child.mask);
+        }
+        else if (!generateMoves(&child)) {
+            score = 0;
+        }
+        else {
+            // most columns score at most the best one so far, testing that bound first settles them quickly
+            int best = __atomic_load_n(&analysis->best, __ATOMIC_RELAXED);
+            score = -solveGuess(&child, analysis->table, analysis->weak, 1, 0,
+                                (best > -MAX_STONES) ? -best : NO_GUESS, 0, NULL, &result);
+            __atomic_add_fetch(&analysis->nodes, result.nodes, __ATOMIC_RELAXED);
+        }
+
+        // the weak solver only tells the sign of the score
+        if (analysis->weak)
+            score = (score > 0) - (score < 0);
+
+        analysis->scores[col] = score;
+        int best = __atomic_load_n(&analysis->best, __ATOMIC_RELAXED);
+        while (score > best && !__atomic_compare_exchange_n(&analysis->best, &best, score, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+
+    return NULL;
+}
+
+// score every column for the player to move (NO_SCORE for a full column) and return the nodes searched
+// the columns share the table, with several threads each column is solved by one of them
+unsigned long long analyzePosition(BoardState* board, HashTable* table, int weak, int threadCount, int scores[WIDTH]) {
+    Analysis analysis;
+    analysis.board = board;
+    analysis.table = table;
+    analysis.weak = weak;
+    analysis.next = 0;
+    analysis.best = -MAX_STONES - 1;
+    analysis.scores = scores;
+    analysis.nodes = 0;
+
+    int workers = (threadCount < WIDTH) ? threadCount : WIDTH;
+    pthread_t handles[WIDTH];
+    for (int i = 1; i < workers; i++) {
+        pthread_create(&handles[i], NULL, analysisWorker, &analysis);
+    }
+    analysisWorker(&analysis);
+    for (int i = 1; i < workers; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    return analysis.nodes;
+}
+
+// solve the board within timeLimit seconds using the configured threads, without printing
+int solveTimed(BoardState* board, HashTable* table, int weak, double timeLimit, SolveResult* result) {
+    return solvePosition(board, table, weak, threadCount, timeLimit, result);
+}
+
+// solve the board
+int solve(BoardState* board, HashTable* table, int weak) {
+    double start = getTime();
+    SolveResult result;
+    int eval = solvePosition(board, table, weak, threadCount, 0, &result);
+
+    // an immediate win is returned without searching
+    if (board->nodes == 0)
+        return eval;
+
+    printf("Eval: %d\n", convertEval(eval, board));
     printf("Nodes: %lld\n", board->nodes);
-    printf("Time: %f\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+    printf("Time: %f\n", getTime() - start);
 
     return eval;
 }
@@ -439,14 +1116,18 @@ int playGame(int player) {
     BoardState board;
     initBoard(&board);
     HashTable* table = initHashTable();
-    unsigned long long moveMasker = MOVE_MASK;
-    unsigned long long moves;
-    unsigned long long move;
+    bitboard moveMasker = MOVE_MASK;
+    bitboard moves;
+    bitboard move;
 
     int inBook = 1;
 
-    // get a random hash for the board
-    Entry* entry = table->entries + (board.hash % table->size);
+    Entry entry;
+    Ponder ponder;
+    ponder.running = 0;
+    ponder.solved = 0;
+    GameSession session;
+    initSession(&session, table);
 
     int playing = 1;
     while (playing) {
@@ -454,48 +1135,76 @@ int playGame(int player) {
 
         // check if the game is over
         if (!moves) {
-            printBoard(board);
+            printBoard(&board, player);
             printf("Draw\n");
             playing = 0;
             break;
         }
 
-        printBoard(board);
-        printf(" 6 5 4 3 2 1 0\n");
+        printBoard(&board, player);
+        for (int col = WIDTH - 1; col >= 0; col--) {
+            printf(" %d", col);
+        }
+        printf("\n");
 
-        unsigned long long winningMoves = computeWinningPosition((player) ? board.p2 : board.p1, board.p1 | board.p2);
+        bitboard winningMoves = computeWinningPosition(board.position, board.mask);
 
         // get the computer move
         if (player || SELF_PLAY) {
             if (inBook) {
-                move = findBookMove(BOOK_DIR, &board);
+                bitboard first, second;
+                getFirstStones(&board, &first, &second);
+                move = findBookMove(BOOK_DIR, first, second);
                 if (move != -1) {
                     printf("Book move: %d\n", move);
                     move = moves & (moveMasker << move);
-                    makeMove(&board, move, player, table);
+                    makeMove(&board, move);
                 }
                 else {
                     inBook = 0;
                 }
             }
             if (!inBook) {
-                solve(&board, player, table, WEAK_SOLVER);
-                entry = getEntry(table, board.hash);
-                move = moves & (moveMasker << entry->move);
-                makeMove(&board, move, player, table);
-                printf("Computer plays: %d\n", entry->move);
+                // the reply may have been solved while the player was thinking
+                SolveResult pondered;
+                if (ponderResult(&ponder, &board, &pondered) && pondered.move >= 0) {
+                    printf("Eval: %d (pondered)\n", convertEval(pondered.eval, &board));
+                    updateSession(&session, &board, WEAK_SOLVER, pondered.eval);
+                    entry.move = pondered.move;
+                }
+                else {
+                    // the previous score of the game is the first window of the search
+                    double start = getTime();
+                    SolveResult result;
+                    int eval = solveSession(&session, &board, WEAK_SOLVER, threadCount, 0, &result);
+                    printf("Eval: %d\n", convertEval(eval, &board));
+                    printf("Nodes: %llu\n", result.nodes);
+                    printf("Time: %f\n", getTime() - start);
+                    entry.move = result.move;
+
+                    // the table move if it holds a legal one, otherwise the first move the search would try
+                    if (entry.move < 0)
+                        entry.move = fallbackMove(&board, table);
+                }
+                move = moves & (moveMasker << entry.move);
+                makeMove(&board, move);
+                printf("Computer plays: %d\n", entry.move);
             }
         }
         else {
+            // solve the likely replies in the background while the player thinks
+            if (!inBook)
+                startPonder(&ponder, &board, table, WEAK_SOLVER, threadCount);
             move = getMove();
+            stopPonder(&ponder);
             move = moves & (moveMasker << move);
-            makeMove(&board, move, player, table);
+            makeMove(&board, move);
             
         }
 
         if (winningMoves & move) {
            printf("\n");
-           printBoard(board);
+           printBoard(&board, !player);
            printf("Player %d wins\n", player + 1);
            playing = 0;
            break;
@@ -508,13 +1217,14 @@ int playGame(int player) {
     freeHashTable(table);
 }
 
-// enumerate the positions after n moves
-unsigned long long nPlySearch(int n, BoardState* board, int player, HashTable* table) {
+// count the leaves of the game tree cut at n moves, a game that ends earlier is one leaf
+// transposed positions are counted once for every move order (perft -unique counts them once)
+unsigned long long nPlySearch(int n, BoardState* board, HashTable* table) {
     unsigned long long sum = 0;
 
     // generate all the possible moves
-    unsigned long long moves = generateMoves(board);
-    unsigned long long move;
+    bitboard moves = generateMoves(board);
+    bitboard move;
 
     if (!moves) {
         return 1;
@@ -532,157 +1242,85 @@ unsigned long long nPlySearch(int n, BoardState* board, int player, HashTable* t
             continue;
         }
 
-        makeMove(board, move, player, table);
+        makeMove(board, move);
 
         // check if the game is over
-        if (isAligned(board, player)) {
+        if (isAligned(board)) {
             sum += 1;
         }
         else {
-            sum += nPlySearch(n - 1, board, !player, table);
+            sum += nPlySearch(n - 1, board, table);
         }
 
-        makeMove(board, move, player, table);
+        undoMove(board, move);
     }
 
     // return the sum we only want to count leaf nodes
     return sum;
 }
 
-// precompute opening moves by recursively enumerating moves the first n moves deep
-int computeBookRecursive(char* bookDir, BoardState* board, int player, HashTable* table, int depth) {
-    Entry* entry = getEntry(table, board->hash);
-    unsigned long long moves = generateMoves(board);
-    unsigned long long move;
-    int eval = -100;
-    int storeMove;
-
-    // once the search hits depth solve the position and add it to the book
-    if (depth >= BOOK_COMPUTE_DEPTH) {
-        eval = solve(board, player, table, WEAK_SOLVER);
-        entry = getEntry(table, board->hash);
-        storeMove = entry->move;
+int main(int argc, char* argv[]) {
+    // compile a text book into the memory-mapped format
+    if (argc == 4 && strcmp(argv[1], "convert") == 0) {
+        return convertBook(argv[2], argv[3]);
     }
 
-    // otherwise explore like normal and backpropagate the eval to the root
-    else {
-        char exploreOrder[] = { 3, 2, 4, 1, 5, 0, 6 };
-        moves = getNonLosingMove(board, moves, player);
-        int losingStart = sortMoves(board, moves, exploreOrder, player, entry);
-        storeMove = exploreOrder[0];
-
-        for (int i = 0; i < losingStart; i++) {
-            move = moves & (MOVE_MASK << exploreOrder[i]);
-
-            // make move
-            makeMove(board, move, player, table);
-
-            int moveEval = -computeBookRecursive(bookDir, board, !player, table, depth + 1);
-
-            // un-make the move
-            makeMove(board, move, player, table);
-
-            // do not prune moves since we want an expansive book
-            if (moveEval > eval) {
-                eval = moveEval;
-                storeMove = exploreOrder[i];
-            }
-        }
+    // sort the solves appended to a solve cache into it, compact <cache>
+    if (argc == 3 && strcmp(argv[1], "compact") == 0) {
+        return compactCache(argv[2]);
     }
 
-    // write the position to the book file
-    FILE* file = fopen(bookDir, "a");
-    fprintf(file, "%llu %llu %d %d\n", board->p1, board->p2, storeMove, eval);
-    fclose(file);
-
-    return eval;
-}
-
-void computeBook(char* bookDir) {
-    BoardState board;
-    initBoard(&board);
-    HashTable* table = initHashTable();
-    printf("Positions: %lld\n", nPlySearch(BOOK_COMPUTE_DEPTH, &board, 0, table));
-    computeBookRecursive(bookDir, &board, 1, table, 0);
-    freeHashTable(table);
-}
-
-// run the benchmark tests
-int benchmark(char* filename) {
-    // open the file
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Error opening file\n");
-        return 1;
+    // options before the mode, -t <threads> and -m <table size in MB>
+    int arg = 1;
+    while (argc > arg + 1 && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-t") == 0)
+            setThreadCount(atoi(argv[arg + 1]));
+        else if (strcmp(argv[arg], "-m") == 0)
+            setHashTableSize(strtoull(argv[arg + 1], NULL, 10));
+        else
+            break;
+        arg += 2;
     }
-    
-    // for each line of the file solve the board
-    char line[100];
-    BoardState board;
-    initBoard(&board);
-    HashTable* table = initHashTable();
-    int solved = 0;
-
-    unsigned long long nodes = nPlySearch(BOOK_COMPUTE_DEPTH, &board, 0, table);
-    printf("Positions: %lld\n", nodes);
-
-    // get the start time
-    clock_t start = clock();
-
-    while (fgets(line, sizeof(line), file)) {
-        // convert the line to a board
-        int i;
-        int player = 0;
-        for (i = 0; line[i] != ' '; i++) {
-            unsigned long long moves = generateMoves(&board);
-            if (!player) {
-                makeMove(&board, MOVE_MASK << (line[i] - '0' - 1) & moves, player, table);
-            }
-            else if (player) {
-                makeMove(&board, MOVE_MASK << (line[i] - '0' -  1) & moves, player, table);
-            }
-            player = !player;        
-        }
-
-        // get the expected result
-        int expected = atoi(line + i + 1);
 
-        // solve the board
-        int found = solve(&board, player, table, WEAK_SOLVER);
+    // build an opening book or one shard of it, book [options] <depth> <output>
+    if (argc > arg && strcmp(argv[arg], "book") == 0) {
+        return computeBook(argc - arg - 1, argv + arg + 1);
+    }
 
-        if (expected != found && !WEAK_SOLVER) {
-            printf("\nError: %d %d\n", expected, found);
-            printBoard(board);
-            printBinBoard(board.hash);
-        }
-        else if (expected * found < 0 && WEAK_SOLVER) {
-            printf("\nError: %d %d\n", expected, found);
-            printBoard(board);
-            printBinBoard(board.hash);
-        }
-        printf("Solved: %d\n", ++solved);
+    // combine book shards and books into one book, merge <depth> <output> <books>
+    if (argc > arg && strcmp(argv[arg], "merge") == 0) {
+        return mergeBooks(argc - arg - 1, argv + arg + 1);
+    }
 
-        // reset the board and hash table
-        board.p1 = 0;
-        board.p2 = 0;
-        board.hash = 0;
+    // benchmark the solver, bench [options] <files>
+    if (argc > arg && strcmp(argv[arg], "bench") == 0) {
+        return benchmark(argc - arg - 1, argv + arg + 1);
+    }
 
-        // not clearing the table leads to hash collisions in some test positions!?
-        memset(table->entries, 0, table->size * sizeof(Entry));
+    // time the solver kernels one by one, micro [options] <files>
+    if (argc > arg && strcmp(argv[arg], "micro") == 0) {
+        return microbenchmark(argc - arg - 1, argv + arg + 1);
     }
 
-    // get the end time
-    clock_t end = clock();
+    // count positions per ply, perft [-unique] <depth>
+    if (argc > arg && strcmp(argv[arg], "perft") == 0) {
+        return perft(argc - arg - 1, argv + arg + 1);
+    }
 
-    // print the mean time per board
-    printf("\nMean time per board: %f\n", (double)(end - start) / CLOCKS_PER_SEC / solved);
+    // write solver labelled positions for training, generate [options] <output>
+    if (argc > arg && strcmp(argv[arg], "generate") == 0) {
+        return generate(argc - arg - 1, argv + arg + 1);
+    }
 
-    fclose(file);
-}
+    // answer requests with a warm table, serve [options]
+    if (argc > arg && strcmp(argv[arg], "serve") == 0) {
+        return serve(argc - arg - 1, argv + arg + 1);
+    }
 
-int main(int argc, char* argv[]) {
-    //computeBook("OpeningBook");
-    benchmark(argv[1]);
+    // a bare list of files is benchmarked with the default options
+    if (argc > arg) {
+        return benchmark(argc - arg, argv + arg);
+    }
 
     int player = 0;
     printf("Enter 0 to play first or 1 to play second:\n");
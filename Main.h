@@ -5,38 +5,169 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include"Board.h"
 #include"HashTable.h"
+#include"Book.h"
+#include"Cache.h"
+#include"Engine.h"
+
+#define MOVE_LANES ((WIDTH + 7) / 8 * 8) // candidate moves scored at once, WIDTH rounded up to a vector of 64-bit lanes
+
+#define MAX_THREADS 64
+#define DEADLINE_CHECK_NODES 4095 // the clock is read once every this many + 1 nodes
+#define ETC_MIN_EMPTY 4 // children are checked for transposition cutoffs with at least this many empty cells
+
+// Outcome of a solve for the player to move
+#define OUTCOME_LOSS -1
+#define OUTCOME_DRAW 0
+#define OUTCOME_WIN 1
+#define OUTCOME_UNKNOWN 2
+
+#define NO_GUESS 100 // no first window for the root search
+#define PV_WORK PINNED_WORK // work of pinned principal variation entries, above that of any search so they are never evicted
+#define NO_SCORE -100 // analysis score of a column that can't be played
 
 // Structs
+
+// A position as the stones of the player to move and the mask of every stone. Playing a move hands
+// the position to the opponent (position ^= mask, mask |= move), so the search never needs to know
+// which player is to move. Boards given by the stones of each player are read with setBoard
 typedef struct {
-    unsigned long long p1;
-    unsigned long long p2;
+    bitboard position;
+    bitboard mask;
     unsigned long long nodes;
-    unsigned long hash;
 } BoardState;
 
+// State owned by one search thread, every thread searches the same root
+// with its own board copy and column order and they share the table (Lazy SMP)
+typedef struct {
+    BoardState board;
+    HashTable* table;
+    int weak;
+    int id;
+    char order[WIDTH];
+    volatile int* stop;
+    int* winner;
+    int eval;
+    Entry root;
+    unsigned long long probes;
+    unsigned long long hits;
+    double deadline; // getTime() value to stop at, 0 for none
+    volatile int* cancel; // set by another thread to stop the search, NULL for none
+    int lower; // bounds on the score proven by finished iterations
+    int upper;
+    char bestMove; // move behind the lower bound, -1 until an iteration fails high
+    int complete;
+    int guess; // score tested by the first window, NO_GUESS for none
+    int widen; // 1 to probe next to the guess after it fails instead of halving the range
+#if SEARCH_STATS
+    SearchStats stats;
+#endif
+} SearchThread;
+
+// Result of solving a position
+typedef struct {
+    int eval;
+    char move;
+    unsigned long long nodes;
+    unsigned long long probes; // transposition table probes
+    unsigned long long hits;
+    int complete; // 0 if the time limit ran out, eval is then only valid if the outcome is known
+    int lower; // bounds on the score, equal to eval when complete
+    int upper;
+    int outcome; // OUTCOME_WIN, OUTCOME_DRAW, OUTCOME_LOSS or OUTCOME_UNKNOWN
+#if SEARCH_STATS
+    SearchStats stats;
+#endif
+} SolveResult;
+
+// Pondering solves the replies of the opponent in a background thread while the opponent thinks,
+// the likely replies first. The results go into the table and the complete ones are also kept
+typedef struct {
+    BoardState board; // the position with the opponent to move
+    HashTable* table;
+    int weak;
+    int threads;
+    volatile int cancel;
+    int running;
+    pthread_t handle;
+    bitboard replies[WIDTH]; // the replies in the order they are solved
+    SolveResult results[WIDTH];
+    int solved; // replies with a complete result, a prefix of replies
+} Ponder;
+
+// A game session carries the last exact score of a game to the next solve, a later position of the
+// same game starts its search with a null window at that score. The entries along the principal
+// variation of the last solve are pinned in the table until the next one
+typedef struct {
+    HashTable* table;
+    BoardState board; // the last position solved exactly
+    int score;
+    int weak;
+    int valid;
+    BoardState pv[WIDTH * HEIGHT]; // the positions along the principal variation
+    char pvWork[WIDTH * HEIGHT]; // work of their entries before they were pinned
+    int pvLength;
+} GameSession;
+
 // Function Prototypes
 void initBoard(BoardState* board);
-void printBin(unsigned long long n);
-void printBinBoard(unsigned long long n);
-void printBoard(BoardState board);
+void printBin(bitboard n);
+void printBinBoard(bitboard n);
+void printBoard(BoardState* board, int player);
+double getTime();
 int getMove();
 HashTable* getInitTable();
-int convertEval(int eval, int player, BoardState* board);
-int findBookMove(char* bookDir, BoardState* board);
-unsigned long long computeWinningPosition(unsigned long long position, unsigned long long occupied);
-unsigned long long isAligned(BoardState* board, int player);
-void makeMove(BoardState* board, unsigned long long move, int player, HashTable* table);
-unsigned long long generateMoves(BoardState* board);
-unsigned long long getNonLosingMove(BoardState* board, unsigned long long moves, int player);
-void sortArray(char* sortArray, char* valArray, int size);
-int sortMoves(BoardState* board, unsigned long long moves, char order[], int player, Entry* entry);
-int negamax(BoardState* board, int player, int alpha, int beta, HashTable* table);
-int solve(BoardState* board, int player, HashTable* table, int weak);
+int convertEval(int eval, BoardState* board);
+int findBookMove(char* bookDir, bitboard first, bitboard second);
+bitboard computeWinningPosition(bitboard position, bitboard occupied);
+int isAligned(BoardState* board);
+bitboard mirrorBoard(bitboard stones);
+bitboard positionKey(BoardState* board);
+unsigned long long tableKey(BoardState* board);
+int getBoardEntry(HashTable* table, BoardState* board, Entry* entry);
+int addBoardEntry(HashTable* table, BoardState* board, char value, char move, char flag, int work);
+void setBoard(BoardState* board, bitboard p1, bitboard p2, int player);
+void getStones(BoardState* board, int player, bitboard* p1, bitboard* p2);
+void getFirstStones(BoardState* board, bitboard* first, bitboard* second);
+void makeMove(BoardState* board, bitboard move);
+void undoMove(BoardState* board, bitboard move);
+bitboard playColumn(BoardState* board, int col);
+bitboard generateMoves(BoardState* board);
+bitboard getNonLosingMove(BoardState* board, bitboard moves);
+int hasAlignment(bitboard stones);
+void centerOrder(char order[WIDTH]);
+int parityBounds(BoardState* board, int* lower, int* upper);
+void initScoreKernel();
+const char* getScoreKernel();
+void scoreMoves(bitboard position, bitboard occupied, const bitboard* moves, char* score);
+int sortMoves(BoardState* board, bitboard moves, char order[], Entry* entry);
+int negamax(BoardState* board, int alpha, int beta, SearchThread* thread);
+int searchRoot(SearchThread* thread);
+void setThreadCount(int threads);
+int getThreadCount();
+char fallbackMove(BoardState* board, HashTable* table);
+int solvePosition(BoardState* board, HashTable* table, int weak, int threadCount, double timeLimit, SolveResult* result);
+unsigned long long analyzePosition(BoardState* board, HashTable* table, int weak, int threadCount, int scores[WIDTH]);
+int solveCancellable(BoardState* board, HashTable* table, int weak, int threadCount, volatile int* cancel, SolveResult* result);
+void initSession(GameSession* session, HashTable* table);
+void endSession(GameSession* session);
+void updateSession(GameSession* session, BoardState* board, int weak, int score);
+int solveSession(GameSession* session, BoardState* board, int weak, int threadCount, double timeLimit, SolveResult* result);
+int solveTimed(BoardState* board, HashTable* table, int weak, double timeLimit, SolveResult* result);
+int solve(BoardState* board, HashTable* table, int weak);
+void startPonder(Ponder* ponder, BoardState* board, HashTable* table, int weak, int threads);
+void stopPonder(Ponder* ponder);
+int ponderResult(Ponder* ponder, BoardState* board, SolveResult* result);
 int playGame(int player);
-unsigned long long nPlySearch(int n, BoardState* board, int player, HashTable* table);
-int computeBookRecursive(char* bookDir, BoardState* board, int player, HashTable* table, int depth);
-void computeBook(char* bookDir);
-int benchmark(char* filename);
+unsigned long long nPlySearch(int n, BoardState* board, HashTable* table);
+int computeBook(int argc, char* argv[]);
+int mergeBooks(int argc, char* argv[]);
+int benchmark(int argc, char* argv[]);
+int microbenchmark(int argc, char* argv[]);
+int perft(int argc, char* argv[]);
+int generate(int argc, char* argv[]);
+int serve(int argc, char* argv[]);
 
 #endif // CONNECT4_H
\ No newline at end of file
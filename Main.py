@@ -6,97 +6,164 @@ import time
 import random
 
 DELTA_RANGE = (0.0, 0.0)
+MOVE_TIME_LIMIT = 2.0  # seconds the solver may spend on a move
 BOARD_SIZE = (7, 6)  # Default board size
 
 class Connect4Engine:
-    def __init__(self, lib_path):
-        self.book_path = "OpeningBook5"
+    def __init__(self, lib_path, threads=1, table_mb=0):
+        self.book_path = "OpeningBook5.bin"
 
         # Load the shared library
         self.lib = ctypes.CDLL(lib_path, winmode=0)
 
         # Define argument and return types for the shared library functions
-        self.lib.initHashTable.argtypes = []
-        self.lib.initHashTable.restype = ctypes.POINTER(HashTable)
-        self.lib.getInitBoard.argtypes = []
-        self.lib.getInitBoard.restype = ctypes.POINTER(BoardState)
-        self.lib.initBoard.argtypes = [ctypes.POINTER(BoardState)]
-        self.lib.printBoard.argtypes = [BoardState]
-        self.lib.getMove.restype = ctypes.c_int
-        self.lib.makeMove.argtypes = [ctypes.POINTER(BoardState), ctypes.c_ulonglong, ctypes.c_int, ctypes.POINTER(HashTable)]
+        self.lib.setBoard.argtypes = [ctypes.POINTER(BoardState), ctypes.c_ulonglong, ctypes.c_ulonglong, ctypes.c_int]
+        self.lib.printBoard.argtypes = [ctypes.POINTER(BoardState), ctypes.c_int]
         self.lib.generateMoves.argtypes = [ctypes.POINTER(BoardState)]
         self.lib.generateMoves.restype = ctypes.c_ulonglong
-        self.lib.solve.argtypes = [ctypes.POINTER(BoardState), ctypes.c_int, ctypes.POINTER(HashTable), ctypes.c_int]
-        self.lib.solve.restype = ctypes.c_int
-        self.lib.getEntry.argtypes = [ctypes.POINTER(HashTable), ctypes.c_ulong]
-        self.lib.getEntry.restype = ctypes.POINTER(Entry)
-        self.lib.findBookMove.argtypes = [ctypes.c_char_p, ctypes.POINTER(BoardState)]
+        self.lib.findBookMove.argtypes = [ctypes.c_char_p, ctypes.c_ulonglong, ctypes.c_ulonglong]
         self.lib.findBookMove.restype = ctypes.c_int
         self.lib.computeWinningPosition.argtypes = [ctypes.c_ulonglong, ctypes.c_ulonglong]
         self.lib.computeWinningPosition.restype = ctypes.c_ulonglong
-
-        # Initialize board and hash table
-        self.board = self.lib.getInitBoard()
-        self.hash_table = self.lib.initHashTable()
+        self.lib.engineCreate.argtypes = [ctypes.c_ulonglong, ctypes.c_int]
+        self.lib.engineCreate.restype = ctypes.c_void_p
+        self.lib.engineFree.argtypes = [ctypes.c_void_p]
+        self.lib.engineSetThreads.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.lib.engineSetWeak.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.lib.engineSetTimeLimit.argtypes = [ctypes.c_void_p, ctypes.c_double]
+        self.lib.engineClear.argtypes = [ctypes.c_void_p]
+        self.lib.engineSolve.argtypes = [ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_ulonglong, ctypes.c_int, ctypes.POINTER(EngineResult)]
+        self.lib.engineSolve.restype = ctypes.c_int
+        self.lib.engineAnalyze.argtypes = [ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_ulonglong, ctypes.c_int, ctypes.POINTER(EngineAnalysis)]
+        self.lib.engineAnalyze.restype = ctypes.c_int
+        self.lib.enginePonder.argtypes = [ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_ulonglong, ctypes.c_int]
+        self.lib.enginePonder.restype = ctypes.c_int
+        self.lib.engineStopPonder.argtypes = [ctypes.c_void_p]
+        self.lib.engineSetSession.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.lib.engineNewGame.argtypes = [ctypes.c_void_p]
+
+        # Initialize the board and the engine, the engine owns the table
+        self.board = PlayerBoard()
+        self.engine = self.lib.engineCreate(table_mb, threads)
+        if not self.engine:
+            raise MemoryError("could not allocate the engine")
+
+        # solves carry the score of the game to the next move
+        self.lib.engineSetSession(self.engine, 1)
+
+    def close(self):
+        if self.engine:
+            self.lib.engineFree(self.engine)
+            self.engine = None
+
+    def solver_board(self):
+        # the solver keeps the stones of the player to move and a mask, set up with player 0 to move
+        board = BoardState()
+        self.lib.setBoard(ctypes.byref(board), self.board.p1, self.board.p2, 0)
+        return board
 
     def print_board(self):
-        self.lib.printBoard(self.board.contents)
+        self.lib.printBoard(ctypes.byref(self.solver_board()), 0)
 
     def reset_board(self):
-        self.board = self.lib.getInitBoard()
-        self.hash_table = self.lib.initHashTable()
+        # table keys are exact so the table stays valid for the next game
+        self.board = PlayerBoard()
+        self.lib.engineNewGame(self.engine)
 
-    def get_move(self):
-        return self.lib.getMove()
+    def clear_table(self):
+        self.lib.engineClear(self.engine)
 
     def make_move(self, move, player):
-        self.lib.makeMove(self.board, move, player, self.hash_table)
+        if player:
+            self.board.p2 |= move
+        else:
+            self.board.p1 |= move
 
     def generate_moves(self):
-        return self.lib.generateMoves(self.board)
+        return self.lib.generateMoves(ctypes.byref(self.solver_board()))
+
+    def set_threads(self, threads):
+        self.lib.engineSetThreads(self.engine, threads)
+
+    def solve_timed(self, player, weak_solver, time_limit):
+        # returns the result with the best move found and the outcome proven within the time limit,
+        # None if the position is invalid or has no move to play
+        result = EngineResult()
+        self.lib.engineSetWeak(self.engine, weak_solver)
+        self.lib.engineSetTimeLimit(self.engine, time_limit)
+        board = self.board
+        if self.lib.engineSolve(self.engine, board.p1, board.p2, player, ctypes.byref(result)) != 0:
+            return None
+        if result.move < 0:
+            return None
+        return result
+
+    def analyze(self, player, weak_solver):
+        # scores of every column for the player, None for a full column
+        analysis = EngineAnalysis()
+        self.lib.engineSetWeak(self.engine, weak_solver)
+        board = self.board
+        if self.lib.engineAnalyze(self.engine, board.p1, board.p2, player, ctypes.byref(analysis)) != 0:
+            return None
+        return [None if score == ENGINE_NO_SCORE else score for score in analysis.scores]
+
+    def ponder(self, player):
+        # solve the replies of the opponent (player) in the background until the next solve
+        board = self.board
+        return self.lib.enginePonder(self.engine, board.p1, board.p2, player) == 0
+
+    def stop_ponder(self):
+        self.lib.engineStopPonder(self.engine)
 
-    def solve(self, player, weak_solver):
-        return self.lib.solve(self.board, player, self.hash_table, weak_solver)
-    
-    def get_entry(self, hash_):
-        return self.lib.getEntry(self.hash_table, hash_)
-    
-    def get_move(self):
-        entry_p = self.get_entry(self.board.contents.hash)
-        return int.from_bytes(entry_p.contents.move, byteorder='big')
-    
     def compute_winning_position(self, last_move, last_player):
-        win_mask = self.lib.computeWinningPosition(self.board.contents.p2 if last_player else self.board.contents.p1, (self.board.contents.p2 | self.board.contents.p1) ^ last_move)
+        win_mask = self.lib.computeWinningPosition(self.board.p2 if last_player else self.board.p1, (self.board.p2 | self.board.p1) ^ last_move)
         if win_mask & last_move:
             return True
         return False
 
     def find_book_move(self, book_path):
-        return self.lib.findBookMove(book_path.encode("utf-8"), self.board)
+        return self.lib.findBookMove(book_path.encode("utf-8"), self.board.p1, self.board.p2)
 
-class BoardState(ctypes.Structure):
+# the stones of each player, as the engine functions take them
+class PlayerBoard(ctypes.Structure):
     _fields_ = [
         ("p1", ctypes.c_ulonglong),
-        ("p2", ctypes.c_ulonglong),
-        ("nodes", ctypes.c_ulonglong),
-        ("hash", ctypes.c_ulong)
+        ("p2", ctypes.c_ulonglong)
     ]
 
-class Entry(ctypes.Structure):
+class BoardState(ctypes.Structure):
     _fields_ = [
-        ("hash", ctypes.c_ulong),
-        ("value", ctypes.c_char),
-        ("move", ctypes.c_char),
-        ("flag", ctypes.c_char)
+        ("position", ctypes.c_ulonglong),
+        ("mask", ctypes.c_ulonglong),
+        ("nodes", ctypes.c_ulonglong)
     ]
 
-class HashTable(ctypes.Structure):
+OUTCOME_LOSS, OUTCOME_DRAW, OUTCOME_WIN, OUTCOME_UNKNOWN = -1, 0, 1, 2
+ENGINE_NO_SCORE = -100
+
+class EngineResult(ctypes.Structure):
     _fields_ = [
-        ("entries", ctypes.POINTER(Entry)),
-        ("zobrist", ctypes.POINTER(ctypes.c_ulong)),
-        ("size", ctypes.c_ulonglong)
+        ("score", ctypes.c_int),
+        ("move", ctypes.c_int),
+        ("nodes", ctypes.c_ulonglong),
+        ("seconds", ctypes.c_double),
+        ("complete", ctypes.c_int),
+        ("lower", ctypes.c_int),
+        ("upper", ctypes.c_int),
+        ("outcome", ctypes.c_int),
+        ("book", ctypes.c_int),
+        ("cached", ctypes.c_int),
+        ("pondered", ctypes.c_int)
     ]
 
+class EngineAnalysis(ctypes.Structure):
+    _fields_ = [
+        ("scores", ctypes.c_int * 7),
+        ("move", ctypes.c_int),
+        ("score", ctypes.c_int),
+        ("nodes", ctypes.c_ulonglong),
+        ("seconds", ctypes.c_double)
+    ]
 
 class ScreenReader:
     def __init__(self, board_size=BOARD_SIZE, delay=0.01, delta_range=DELTA_RANGE):
@@ -246,8 +313,13 @@ if __name__ == "__main__":
                     else:
                         in_book = False
                 if not in_book:
-                    eval_ = engine.solve(cur_player, solve_type)
-                    move = engine.get_move()
+                    result = engine.solve_timed(cur_player, solve_type, MOVE_TIME_LIMIT)
+                    if result is None:
+                        print("No move found")
+                        engine.stop_ponder()
+                        engine.reset_board()
+                        break
+                    move = result.move
                     possibleMoves = engine.generate_moves()
                     engine.make_move(possibleMoves & (moveMask << move), cur_player)
                     screen_reader.make_move(move)
@@ -255,8 +327,12 @@ if __name__ == "__main__":
                 print()
 
             elif cur_player != bot_player:
+                # solve the likely replies while the opponent thinks, the next solve stops it
+                if not in_book:
+                    engine.ponder(cur_player)
                 move = screen_reader.get_move_from_screen()
                 if move == -1:
+                    engine.stop_ponder()
                     engine.reset_board()
                     break
 
@@ -267,17 +343,20 @@ if __name__ == "__main__":
 
             if engine.compute_winning_position(possibleMoves & (moveMask << move), cur_player):
                 print("Player", cur_player, "wins!")
+                engine.stop_ponder()
                 engine.reset_board()
                 break
 
-            if engine.board.contents.p1 | engine.board.contents.p2 == 0xffffffffffff:
+            if engine.board.p1 | engine.board.p2 == 0xffffffffffff:
                 print("Draw!")
+                engine.stop_ponder()
                 engine.reset_board()
                 break
 
             # if there is more than 9 pieces on the board change solve to 0
-            if (engine.board.contents.p1 | engine.board.contents.p2).bit_count() > 6:
+            # weak solver results are only bounds around a draw, start the strong solver with an empty table
+            if solve_type and (engine.board.p1 | engine.board.p2).bit_count() > 6:
                 solve_type = 0
-                engine.hash_table = engine.lib.initHashTable()
+                engine.clear_table()
 
             cur_player = 1 - cur_player
\ No newline at end of file
@@ -0,0 +1,403 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sched_setaffinity
+#endif
+#include <math.h>
+#include "Main.h"
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define MICRO_POSITIONS 4096 // default corpus size
+#define MICRO_REPS 15 // default timed repetitions of every kernel
+#define MICRO_MAX_FILES 16
+#define MICRO_WARMUP 0.2 // seconds a kernel runs before it is timed
+#define MICRO_MIN_REP 0.02 // seconds a repetition runs at least, the corpus is passed over until then
+#define MICRO_REGRESSION 10.0 // default percent a kernel can be slower than the baseline before it is a regression
+
+// The positions every kernel runs over, along with what the kernels take besides the board
+typedef struct {
+    BoardState* boards;
+    bitboard* moves;
+    bitboard* nonLosing; // the moves that don't lose at once, or every move if they all do
+    bitboard (*candidates)[MOVE_LANES]; // the moves by column in center order as sortMoves scores them
+    unsigned long long* keys;
+    unsigned long long count;
+    char order[WIDTH];
+    HashTable* table;
+} MicroCorpus;
+
+// A kernel makes one call per position of the corpus and returns a checksum so the calls aren't optimized out
+typedef struct {
+    const char* name;
+    unsigned long long (*run)(MicroCorpus* corpus);
+} MicroKernel;
+
+// Timings of one kernel in nanoseconds per call
+typedef struct {
+    char kernel[64];
+    double mean;
+    double min;
+    double stddev;
+    double cv; // stddev as a percent of the mean
+    double opsPerSecond;
+} MicroResult;
+
+static volatile unsigned long long sink;
+
+static unsigned long long runGenerateMoves(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        sum += (unsigned long long)generateMoves(&corpus->boards[i]);
+    }
+    return sum;
+}
+
+static unsigned long long runMakeMove(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        BoardState* board = &corpus->boards[i];
+        bitboard move = corpus->moves[i] & -corpus->moves[i];
+        makeMove(board, move);
+        sum += (unsigned long long)board->position;
+        undoMove(board, move);
+    }
+    return sum;
+}
+
+static unsigned long long runWinningPosition(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        BoardState* board = &corpus->boards[i];
+        sum += (unsigned long long)computeWinningPosition(board->position, board->mask);
+    }
+    return sum;
+}
+
+static unsigned long long runHasAlignment(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        BoardState* board = &corpus->boards[i];
+        sum += hasAlignment(board->position | (corpus->moves[i] & -corpus->moves[i]));
+    }
+    return sum;
+}
+
+static unsigned long long runNonLosingMove(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        sum += (unsigned long long)getNonLosingMove(&corpus->boards[i], corpus->moves[i]);
+    }
+    return sum;
+}
+
+static unsigned long long runParityBounds(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        int lower, upper;
+        parityBounds(&corpus->boards[i], &lower, &upper);
+        sum += lower * 64 + upper;
+    }
+    return sum;
+}
+
+static unsigned long long runScoreMoves(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        BoardState* board = &corpus->boards[i];
+        char score[MOVE_LANES];
+        scoreMoves(board->position, board->mask, corpus->candidates[i], score);
+        sum += score[0] + score[WIDTH - 1];
+    }
+    return sum;
+}
+
+static unsigned long long runSortMoves(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        char order[WIDTH];
+        memcpy(order, corpus->order, WIDTH);
+        sum += sortMoves(&corpus->boards[i], corpus->nonLosing[i], order, NULL) + order[0];
+    }
+    return sum;
+}
+
+static unsigned long long runTableKey(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        sum += tableKey(&corpus->boards[i]);
+    }
+    return sum;
+}
+
+static unsigned long long runAddEntry(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        sum += addEntry(corpus->table, corpus->keys[i], (char)(i % 21), (char)(i % WIDTH), EXACT, 1);
+    }
+    return sum;
+}
+
+static unsigned long long runGetEntry(MicroCorpus* corpus) {
+    unsigned long long sum = 0;
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        Entry entry;
+        if (getEntry(corpus->table, corpus->keys[i], &entry))
+            sum += entry.value;
+    }
+    return sum;
+}
+
+static MicroKernel kernels[] = {
+    { "generateMoves", runGenerateMoves },
+    { "makeMove", runMakeMove }, // with the undoMove after it
+    { "computeWinningPosition", runWinningPosition },
+    { "hasAlignment", runHasAlignment },
+    { "getNonLosingMove", runNonLosingMove },
+    { "parityBounds", runParityBounds },
+    { "scoreMoves", runScoreMoves },
+    { "sortMoves", runSortMoves }, // scoreMoves and the ordering network
+    { "tableKey", runTableKey },
+    { "addEntry", runAddEntry },
+    { "getEntry", runGetEntry }, // every key was just stored
+};
+
+// every position along the move sequences of the test files, the corpus is shared evenly between the files
+static int readCorpus(char** files, int fileCount, BoardState* boards, unsigned long long capacity, unsigned long long* count) {
+    char line[100];
+    *count = 0;
+
+    for (int f = 0; f < fileCount; f++) {
+        FILE* file = fopen(files[f], "r");
+        if (file == NULL) {
+            printf("Error opening file %s\n", files[f]);
+            return 1;
+        }
+
+        unsigned long long end = capacity * (f + 1) / fileCount;
+        while (*count < end && fgets(line, sizeof(line), file)) {
+            BoardState board;
+            initBoard(&board);
+
+            for (int i = 0; line[i] >= '1' && line[i] <= '0' + WIDTH && *count < end; i++) {
+                if (!playColumn(&board, line[i] - '1') || isAligned(&board) || !generateMoves(&board))
+                    break;
+                boards[(*count)++] = board;
+            }
+        }
+        fclose(file);
+    }
+
+    return 0;
+}
+
+static void initCorpus(MicroCorpus* corpus) {
+    centerOrder(corpus->order);
+
+    for (unsigned long long i = 0; i < corpus->count; i++) {
+        BoardState* board = &corpus->boards[i];
+        corpus->moves[i] = generateMoves(board);
+        corpus->nonLosing[i] = getNonLosingMove(board, corpus->moves[i]);
+        if (!corpus->nonLosing[i])
+            corpus->nonLosing[i] = corpus->moves[i];
+
+        memset(corpus->candidates[i], 0, sizeof(corpus->candidates[i]));
+        for (int j = 0; j < WIDTH; j++) {
+            corpus->candidates[i][j] = (MOVE_MASK << corpus->order[j]) & corpus->nonLosing[i];
+        }
+
+        corpus->keys[i] = tableKey(board);
+        addEntry(corpus->table, corpus->keys[i], 0, 0, EXACT, 1);
+    }
+}
+
+// keep the benchmark on one cpu so no repetition is timed across a migration, returns 0 if it couldn't be pinned
+static int pinCpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0;
+#else
+    return 0;
+#endif
+}
+
+// warm the kernel up for a while, which also tells how many passes over the corpus a repetition needs,
+// then time every repetition on its own
+static void timeKernel(MicroKernel* kernel, MicroCorpus* corpus, int reps, MicroResult* result) {
+    unsigned long long passes = 0;
+    double start = getTime();
+    double elapsed;
+    do {
+        sink += kernel->run(corpus);
+        passes++;
+        elapsed = getTime() - start;
+    } while (elapsed < MICRO_WARMUP);
+    unsigned long long loops = (unsigned long long)(MICRO_MIN_REP / (elapsed / passes)) + 1;
+
+    double sum = 0;
+    double squares = 0;
+    result->min = 0;
+    for (int r = 0; r < reps; r++) {
+        start = getTime();
+        for (unsigned long long l = 0; l < loops; l++) {
+            sink += kernel->run(corpus);
+        }
+        double ns = (getTime() - start) * 1e9 / (loops * corpus->count);
+
+        sum += ns;
+        squares += ns * ns;
+        if (r == 0 || ns < result->min)
+            result->min = ns;
+    }
+
+    strncpy(result->kernel, kernel->name, sizeof(result->kernel) - 1);
+    result->kernel[sizeof(result->kernel) - 1] = '\0';
+    result->mean = sum / reps;
+    double variance = (reps > 1) ? (squares - sum * sum / reps) / (reps - 1) : 0;
+    result->stddev = (variance > 0) ? sqrt(variance) : 0;
+    result->cv = (result->mean > 0) ? result->stddev / result->mean * 100 : 0;
+    result->opsPerSecond = (result->mean > 0) ? 1e9 / result->mean : 0;
+}
+
+// one kernel per line so a saved report can be read back with the same format
+#define MICRO_FORMAT "    {\"kernel\": \"%s\", \"meanNs\": %.4f, \"minNs\": %.4f, \"stddevNs\": %.4f, " \
+    "\"cv\": %.4f, \"opsPerSecond\": %.1f}"
+#define MICRO_SCAN " {\"kernel\": \"%63[^\"]\", \"meanNs\": %lf, \"minNs\": %lf, \"stddevNs\": %lf, " \
+    "\"cv\": %lf, \"opsPerSecond\": %lf}"
+
+static int writeJson(char* path, MicroResult* results, int count, unsigned long long positions, int reps, int cpu) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Error opening file %s\n", path);
+        return 1;
+    }
+
+    fprintf(file, "{\n  \"positions\": %llu,\n  \"reps\": %d,\n  \"cpu\": %d,\n  \"scoreKernel\": \"%s\",\n  \"kernels\": [\n",
+            positions, reps, cpu, getScoreKernel());
+    for (int i = 0; i < count; i++) {
+        MicroResult* r = &results[i];
+        fprintf(file, MICRO_FORMAT, r->kernel, r->mean, r->min, r->stddev, r->cv, r->opsPerSecond);
+        fprintf(file, (i < count - 1) ? ",\n" : "\n");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return 0;
+}
+
+// compare the fastest repetition of every kernel against a report written by an earlier run,
+// returns the number of kernels that got slower by more than threshold percent
+static int compareBaseline(char* path, MicroResult* results, int count, double threshold) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Error opening file %s\n", path);
+        return -1;
+    }
+
+    char line[512];
+    MicroResult base;
+    int regressions = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, MICRO_SCAN, base.kernel, &base.mean, &base.min, &base.stddev, &base.cv, &base.opsPerSecond) != 6)
+            continue;
+
+        for (int i = 0; i < count; i++) {
+            MicroResult* r = &results[i];
+            if (strcmp(r->kernel, base.kernel) != 0 || base.min <= 0)
+                continue;
+
+            double change = (r->min - base.min) / base.min * 100;
+            int regressed = change > threshold;
+            printf("  %-24s min %8.2f -> %8.2f ns/op (%+.1f%%)%s\n", r->kernel, base.min, r->min, change,
+                   (regressed) ? "  regression" : "");
+            regressions += regressed;
+        }
+    }
+
+    fclose(file);
+    return regressions;
+}
+
+// time the solver kernels one by one on the positions of the test files
+// options: -positions <corpus size>, -reps <timed repetitions>, -cpu <cpu to pin to, -1 for none>, -json <report>,
+// -baseline <report>, -threshold <percent slower than the baseline that fails the run>
+int microbenchmark(int argc, char* argv[]) {
+    unsigned long long capacity = MICRO_POSITIONS;
+    int reps = MICRO_REPS;
+    int cpu = 0;
+    double threshold = MICRO_REGRESSION;
+    char* jsonPath = NULL;
+    char* baselinePath = NULL;
+    char* files[MICRO_MAX_FILES];
+    int fileCount = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-positions") == 0 && i + 1 < argc)
+            capacity = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-cpu") == 0 && i + 1 < argc)
+            cpu = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (fileCount < MICRO_MAX_FILES)
+            files[fileCount++] = argv[i];
+    }
+
+    if (fileCount == 0 || capacity == 0 || reps < 1) {
+        printf("Usage: micro [-positions n] [-reps n] [-cpu n] [-json report] [-baseline report] [-threshold percent] <files>\n");
+        return 1;
+    }
+
+    initScoreKernel();
+    MicroCorpus corpus;
+    corpus.boards = malloc(capacity * sizeof(BoardState));
+    if (readCorpus(files, fileCount, corpus.boards, capacity, &corpus.count) != 0 || corpus.count == 0) {
+        free(corpus.boards);
+        return 1;
+    }
+    corpus.moves = malloc(corpus.count * sizeof(bitboard));
+    corpus.nonLosing = malloc(corpus.count * sizeof(bitboard));
+    corpus.candidates = malloc(corpus.count * sizeof(*corpus.candidates));
+    corpus.keys = malloc(corpus.count * sizeof(unsigned long long));
+    corpus.table = initHashTable();
+    initCorpus(&corpus);
+
+    if (cpu >= 0 && !pinCpu(cpu)) {
+        printf("Could not pin to cpu %d, timing unpinned\n", cpu);
+        cpu = -1;
+    }
+    printf("Positions: %llu  Repetitions: %d  Cpu: %d  Move scoring: %s\n", corpus.count, reps, cpu, getScoreKernel());
+
+    int count = sizeof(kernels) / sizeof(kernels[0]);
+    MicroResult results[sizeof(kernels) / sizeof(kernels[0])];
+    for (int i = 0; i < count; i++) {
+        MicroResult* r = &results[i];
+        timeKernel(&kernels[i], &corpus, reps, r);
+        printf("%-24s mean %8.2f ns/op  min %8.2f  stddev %6.2f (%4.1f%%)  %8.1f Mops/s\n",
+               r->kernel, r->mean, r->min, r->stddev, r->cv, r->opsPerSecond / 1e6);
+    }
+
+    int result = 0;
+    if (jsonPath != NULL)
+        result |= writeJson(jsonPath, results, count, corpus.count, reps, cpu);
+    if (baselinePath != NULL) {
+        printf("vs baseline:\n");
+        int regressions = compareBaseline(baselinePath, results, count, threshold);
+        if (regressions > 0)
+            printf("%d kernels slower than the baseline by more than %.1f%%\n", regressions, threshold);
+        result |= regressions != 0;
+    }
+
+    freeHashTable(corpus.table);
+    free(corpus.boards);
+    free(corpus.moves);
+    free(corpus.nonLosing);
+    free(corpus.candidates);
+    free(corpus.keys);
+    return result;
+}
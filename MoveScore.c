@@ -0,0 +1,132 @@
+#include "Main.h"
+
+// Threat counting for move ordering, every candidate move is scored with the number of
+// winning cells the player has after it. The vector kernels score all the candidates at
+// once, one per 64-bit lane, and are picked at runtime from what the cpu supports.
+// Build with -DNO_SIMD to always use the scalar loop, 128-bit boards always use it
+
+#if !defined(NO_SIMD) && !defined(BITBOARD_128) && (defined(__x86_64__) || defined(__i386__))
+#define MOVE_SCORE_SIMD
+#include <immintrin.h>
+#endif
+
+typedef void (*ScoreKernel)(bitboard, bitboard, const bitboard*, char*);
+
+static void scoreScalar(bitboard position, bitboard occupied, const bitboard* moves, char* score) {
+    for (int i = 0; i < MOVE_LANES; i++) {
+        score[i] = countStones(computeWinningPosition(position | moves[i], occupied | moves[i]));
+    }
+}
+
+#ifdef MOVE_SCORE_SIMD
+// computeWinningPosition for every lane, the shifts are the same as in the scalar version
+#define WINNING_CELLS(VEC, SL, SR, AND, OR, position, r) {                                        \
+    VEC pair;                                                                                     \
+    r = AND(AND(SL(position, WIDTH + 1), SL(position, 2 * (WIDTH + 1))), SL(position, 3 * (WIDTH + 1))); \
+                                                                                                  \
+    pair = AND(SL(position, 1), SL(position, 2));                                                 \
+    r = OR(r, AND(pair, SL(position, 3)));                                                        \
+    r = OR(r, AND(pair, SR(position, 1)));                                                        \
+    pair = AND(SR(position, 1), SR(position, 2));                                                 \
+    r = OR(r, AND(pair, SL(position, 1)));                                                        \
+    r = OR(r, AND(pair, SR(position, 3)));                                                        \
+                                                                                                  \
+    pair = AND(SL(position, WIDTH), SL(position, 2 * WIDTH));                                     \
+    r = OR(r, AND(pair, SL(position, 3 * WIDTH)));                                                \
+    r = OR(r, AND(pair, SR(position, WIDTH)));                                                    \
+    pair = AND(SR(position, WIDTH), SR(position, 2 * WIDTH));                                     \
+    r = OR(r, AND(pair, SL(position, WIDTH)));                                                    \
+    r = OR(r, AND(pair, SR(position, 3 * WIDTH)));                                                \
+                                                                                                  \
+    pair = AND(SL(position, WIDTH + 2), SL(position, 2 * (WIDTH + 2)));                           \
+    r = OR(r, AND(pair, SL(position, 3 * (WIDTH + 2))));                                          \
+    r = OR(r, AND(pair, SR(position, WIDTH + 2)));                                                \
+    pair = AND(SR(position, WIDTH + 2), SR(position, 2 * (WIDTH + 2)));                           \
+    r = OR(r, AND(pair, SL(position, WIDTH + 2)));                                                \
+    r = OR(r, AND(pair, SR(position, 3 * (WIDTH + 2))));                                          \
+}
+
+// two vectors of four lanes, there is no 64-bit popcount in AVX2 so the lanes are counted one by one
+__attribute__((target("avx2,popcnt")))
+static void scoreAvx2(bitboard position, bitboard occupied, const bitboard* moves, char* score) {
+    __m256i boardMask = _mm256_set1_epi64x(BOARD_MASK);
+    __m256i positionVec = _mm256_set1_epi64x(position);
+    __m256i occupiedVec = _mm256_set1_epi64x(occupied);
+    unsigned long long cells[4];
+
+    for (int half = 0; half < MOVE_LANES; half += 4) {
+        __m256i move = _mm256_loadu_si256((const __m256i*)(moves + half));
+        __m256i p = _mm256_or_si256(positionVec, move);
+        __m256i r;
+        WINNING_CELLS(__m256i, _mm256_slli_epi64, _mm256_srli_epi64, _mm256_and_si256, _mm256_or_si256, p, r);
+        r = _mm256_andnot_si256(_mm256_or_si256(occupiedVec, move), _mm256_and_si256(r, boardMask));
+
+        _mm256_storeu_si256((__m256i*)cells, r);
+        for (int i = 0; i < 4; i++) {
+            score[half + i] = __builtin_popcountll(cells[i]);
+        }
+    }
+}
+
+// one vector of eight lanes, a single one holds every candidate on boards up to 8 wide
+__attribute__((target("avx512f,popcnt")))
+static void scoreAvx512(bitboard position, bitboard occupied, const bitboard* moves, char* score) {
+    unsigned long long cells[8];
+
+    for (int base = 0; base < MOVE_LANES; base += 8) {
+        __m512i move = _mm512_loadu_si512((const void*)(moves + base));
+        __m512i p = _mm512_or_si512(_mm512_set1_epi64(position), move);
+        __m512i r;
+
+        WINNING_CELLS(__m512i, _mm512_slli_epi64, _mm512_srli_epi64, _mm512_and_si512, _mm512_or_si512, p, r);
+        r = _mm512_andnot_si512(_mm512_or_si512(_mm512_set1_epi64(occupied), move), _mm512_and_si512(r, _mm512_set1_epi64(BOARD_MASK)));
+
+        _mm512_storeu_si512((void*)cells, r);
+        for (int i = 0; i < 8; i++) {
+            score[base + i] = __builtin_popcountll(cells[i]);
+        }
+    }
+}
+#endif
+
+static ScoreKernel selectKernel(const char** name) {
+#ifdef MOVE_SCORE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt")) {
+        *name = "avx512";
+        return scoreAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        *name = "avx2";
+        return scoreAvx2;
+    }
+#endif
+    *name = "scalar";
+    return scoreScalar;
+}
+
+static ScoreKernel kernel = NULL;
+static const char* kernelName = NULL;
+
+// pick the kernel for this cpu, every thread picks the same one
+void initScoreKernel() {
+    const char* name;
+    ScoreKernel selected = selectKernel(&name);
+    __atomic_store_n(&kernelName, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&kernel, selected, __ATOMIC_RELAXED);
+}
+
+// the name of the kernel scoreMoves uses, NULL until it is picked by initScoreKernel or the first scoreMoves
+const char* getScoreKernel() {
+    return __atomic_load_n(&kernelName, __ATOMIC_RELAXED);
+}
+
+// score the MOVE_LANES candidate moves (0 for an unused lane) of the player
+void scoreMoves(bitboard position, bitboard occupied, const bitboard* moves, char* score) {
+    ScoreKernel selected = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (selected == NULL) {
+        initScoreKernel();
+        selected = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    }
+    selected(position, occupied, moves, score);
+}
@@ -0,0 +1,373 @@
+#include "Main.h"
+
+#define PERFT_SPLIT_TASKS 64 // leaf count tasks per thread, the tree is split at the first ply with this many
+#define PERFT_BUFFER_MB 512ull // default memory for sorting child keys, the same again is used as scratch
+#define PERFT_MAX_RUNS 1024
+#define PERFT_BLOCK 65536 // keys read or written at once
+#define RADIX_BITS 11
+#define KEY_BITS (HEIGHT * (WIDTH + 1) + WIDTH) // highest bit of a position key is the marker of a full column
+
+// A subtree of the leaf count, rooted at the split ply
+typedef struct {
+    BoardState board;
+} PerftTask;
+
+typedef struct {
+    PerftTask* tasks;
+    unsigned long long count;
+    unsigned long long next;
+    unsigned long long leaves;
+    int depth; // plies left below the tasks
+} PerftWork;
+
+// Sorted runs of child keys written to temporary files, merged into the next ply once every parent is expanded
+typedef struct {
+    bitboard* keys;
+    bitboard* scratch;
+    unsigned long long capacity;
+    unsigned long long size;
+    FILE* runs[PERFT_MAX_RUNS];
+    int runCount;
+} RunWriter;
+
+// collect the positions at depth plies as tasks, games that end before count as leaves here
+static void splitTree(BoardState* board, int depth, PerftTask* tasks, unsigned long long* count, unsigned long long* leaves) {
+    bitboard moves = generateMoves(board);
+
+    if (depth == 0 || !moves) {
+        if (tasks != NULL) {
+            tasks[*count].board = *board;
+        }
+        (*count)++;
+        return;
+    }
+
+    for (int i = 0; i < WIDTH; i++) {
+        bitboard move = moves & (MOVE_MASK << i);
+        if (!move)
+            continue;
+
+        makeMove(board, move);
+        if (isAligned(board))
+            (*leaves)++;
+        else
+            splitTree(board, depth - 1, tasks, count, leaves);
+        undoMove(board, move);
+    }
+}
+
+static void* perftWorker(void* arg) {
+    PerftWork* work = (PerftWork*)arg;
+    unsigned long long leaves = 0;
+
+    while (1) {
+        unsigned long long i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (i >= work->count)
+            break;
+
+        PerftTask* task = &work->tasks[i];
+        leaves += nPlySearch(work->depth, &task->board, NULL);
+    }
+
+    __atomic_add_fetch(&work->leaves, leaves, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// count the leaves of the game tree cut at depth plies (as nPlySearch) with every thread,
+// the tree is split at the first ply with enough subtrees to keep the threads busy
+static unsigned long long countLeaves(int depth, int threads) {
+    BoardState board;
+    initBoard(&board);
+
+    int split = 0;
+    unsigned long long count = 1;
+    unsigned long long leaves = 0;
+    while (split < depth && count < (unsigned long long)threads * PERFT_SPLIT_TASKS) {
+        split++;
+        count = 0;
+        leaves = 0;
+        splitTree(&board, split, NULL, &count, &leaves);
+    }
+
+    PerftWork work;
+    work.tasks = malloc(sizeof(PerftTask) * count);
+    work.count = 0;
+    work.next = 0;
+    work.leaves = 0;
+    work.depth = depth - split;
+    leaves = 0;
+    splitTree(&board, split, work.tasks, &work.count, &leaves);
+
+    pthread_t* handles = malloc(sizeof(pthread_t) * threads);
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&handles[i], NULL, perftWorker, &work);
+    }
+    perftWorker(&work);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    free(handles);
+    free(work.tasks);
+    return leaves + work.leaves;
+}
+
+// the key of a position and of its mirror image are counted once, under the smaller of the two
+static bitboard canonicalKey(BoardState* board) {
+    bitboard key = positionKey(board);
+    bitboard mirrorKey = mirrorBoard(key);
+    return (mirrorKey < key) ? mirrorKey : key;
+}
+
+// the board of a position key, the marker is the highest bit of every column and every cell below it is taken
+static void decodeKey(bitboard key, BoardState* board) {
+    bitboard below = key;
+    for (int shift = WIDTH + 1; shift < (HEIGHT + 1) * (WIDTH + 1); shift *= 2) {
+        below |= below >> shift;
+    }
+
+    bitboard occupied = below >> (WIDTH + 1);
+    initBoard(board);
+    board->position = key & occupied;
+    board->mask = occupied;
+}
+
+// sort keys in place with an LSD radix sort, scratch holds as many keys
+static void radixSort(bitboard* keys, bitboard* scratch, unsigned long long count) {
+    static unsigned long long offsets[1 << RADIX_BITS];
+    bitboard* from = keys;
+    bitboard* to = scratch;
+
+    for (int shift = 0; shift < KEY_BITS; shift += RADIX_BITS) {
+        memset(offsets, 0, sizeof(offsets));
+        for (unsigned long long i = 0; i < count; i++) {
+            offsets[(int)(from[i] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+        }
+
+        unsigned long long total = 0;
+        for (int d = 0; d < (1 << RADIX_BITS); d++) {
+            unsigned long long n = offsets[d];
+            offsets[d] = total;
+            total += n;
+        }
+
+        for (unsigned long long i = 0; i < count; i++) {
+            to[offsets[(int)(from[i] >> shift) & ((1 << RADIX_BITS) - 1)]++] = from[i];
+        }
+
+        bitboard* tmp = from;
+        from = to;
+        to = tmp;
+    }
+
+    if (from != keys)
+        memcpy(keys, from, sizeof(bitboard) * count);
+}
+
+// sort the buffered keys and write them out as a run without duplicates
+static int flushRun(RunWriter* writer) {
+    if (writer->size == 0)
+        return 0;
+    if (writer->runCount == PERFT_MAX_RUNS) {
+        printf("Too many runs, give perft a larger buffer\n");
+        return 1;
+    }
+
+    radixSort(writer->keys, writer->scratch, writer->size);
+    unsigned long long unique = 0;
+    for (unsigned long long i = 0; i < writer->size; i++) {
+        if (unique == 0 || writer->keys[unique - 1] != writer->keys[i])
+            writer->keys[unique++] = writer->keys[i];
+    }
+
+    FILE* run = tmpfile();
+    if (run == NULL || fwrite(writer->keys, sizeof(bitboard), unique, run) != unique) {
+        printf("Error writing a temporary file\n");
+        return 1;
+    }
+    rewind(run);
+
+    writer->runs[writer->runCount++] = run;
+    writer->size = 0;
+    return 0;
+}
+
+// a run in the merge with the smallest key it has left
+typedef struct {
+    bitboard key;
+    FILE* file;
+} RunHead;
+
+static void siftDown(RunHead* heap, int count, int i) {
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < count && heap[left].key < heap[smallest].key)
+            smallest = left;
+        if (right < count && heap[right].key < heap[smallest].key)
+            smallest = right;
+        if (smallest == i)
+            return;
+
+        RunHead tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// merge the runs into one sorted file without duplicates, counting the keys and the positions they stand for
+static FILE* mergeRuns(RunWriter* writer, unsigned long long* keys, unsigned long long* positions) {
+    RunHead heap[PERFT_MAX_RUNS];
+    int count = 0;
+    *keys = 0;
+    *positions = 0;
+
+    for (int i = 0; i < writer->runCount; i++) {
+        setvbuf(writer->runs[i], NULL, _IOFBF, PERFT_BLOCK * sizeof(bitboard));
+        if (fread(&heap[count].key, sizeof(bitboard), 1, writer->runs[i]) == 1)
+            heap[count++].file = writer->runs[i];
+    }
+    for (int i = count / 2 - 1; i >= 0; i--) {
+        siftDown(heap, count, i);
+    }
+
+    FILE* out = tmpfile();
+    if (out == NULL) {
+        printf("Error writing a temporary file\n");
+        return NULL;
+    }
+    setvbuf(out, NULL, _IOFBF, PERFT_BLOCK * sizeof(bitboard));
+
+    bitboard last = 0;
+    while (count > 0) {
+        bitboard key = heap[0].key;
+        if (*keys == 0 || key != last) {
+            fwrite(&key, sizeof(bitboard), 1, out);
+            *positions += (mirrorBoard(key) == key) ? 1 : 2;
+            (*keys)++;
+            last = key;
+        }
+
+        if (fread(&heap[0].key, sizeof(bitboard), 1, heap[0].file) != 1)
+            heap[0] = heap[--count];
+        siftDown(heap, count, 0);
+    }
+
+    for (int i = 0; i < writer->runCount; i++) {
+        fclose(writer->runs[i]);
+    }
+    writer->runCount = 0;
+
+    fflush(out);
+    rewind(out);
+    return out;
+}
+
+// count the distinct positions after every number of plies up to depth. A ply is kept on disk as the sorted
+// keys of its positions with mirror images stored once, its children are sorted in memory sized runs and merged
+static int countUnique(int depth, unsigned long long bufferMB) {
+    RunWriter writer;
+    writer.capacity = bufferMB * MB_SIZE / sizeof(bitboard);
+    writer.keys = malloc(sizeof(bitboard) * writer.capacity);
+    writer.scratch = malloc(sizeof(bitboard) * writer.capacity);
+    writer.size = 0;
+    writer.runCount = 0;
+    if (writer.keys == NULL || writer.scratch == NULL) {
+        printf("Error allocating the perft buffer\n");
+        return 1;
+    }
+
+    BoardState board;
+    initBoard(&board);
+    writer.keys[writer.size++] = canonicalKey(&board);
+    if (flushRun(&writer) != 0)
+        return 1;
+
+    unsigned long long keys, positions;
+    FILE* level = mergeRuns(&writer, &keys, &positions);
+    bitboard* block = malloc(sizeof(bitboard) * PERFT_BLOCK);
+    int result = 0;
+
+    for (int ply = 1; ply <= depth && level != NULL; ply++) {
+        double start = getTime();
+        size_t read;
+
+        // expand every parent whose game is still going
+        while (result == 0 && (read = fread(block, sizeof(bitboard), PERFT_BLOCK, level)) > 0) {
+            for (size_t i = 0; i < read && result == 0; i++) {
+                decodeKey(block[i], &board);
+                if (isAligned(&board))
+                    continue;
+
+                bitboard moves = generateMoves(&board);
+                while (moves && result == 0) {
+                    bitboard move = moves & -moves;
+                    moves ^= move;
+
+                    BoardState child = board;
+                    makeMove(&child, move);
+                    if (writer.size == writer.capacity && flushRun(&writer) != 0)
+                        result = 1;
+                    else
+                        writer.keys[writer.size++] = canonicalKey(&child);
+                }
+            }
+        }
+        fclose(level);
+        level = NULL;
+
+        if (result != 0 || flushRun(&writer) != 0)
+            break;
+        level = mergeRuns(&writer, &keys, &positions);
+
+        double seconds = getTime() - start;
+        printf("Ply %d: %llu positions, %llu up to mirror images, %.3f s, %.0f positions/s\n",
+               ply, positions, keys, seconds, (seconds > 0) ? positions / seconds : 0);
+        fflush(stdout);
+    }
+
+    if (level != NULL)
+        fclose(level);
+    free(block);
+    free(writer.keys);
+    free(writer.scratch);
+    return result;
+}
+
+// count positions for every ply up to depth, the leaves of the game tree with every thread by default
+// or with -unique the distinct positions (mirror images counted as two)
+// options: -unique, -buffer <MB of keys sorted in memory>
+int perft(int argc, char* argv[]) {
+    int unique = 0;
+    int depth = -1;
+    unsigned long long bufferMB = PERFT_BUFFER_MB;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-unique") == 0)
+            unique = 1;
+        else if (strcmp(argv[i], "-buffer") == 0 && i + 1 < argc)
+            bufferMB = strtoull(argv[++i], NULL, 10);
+        else
+            depth = atoi(argv[i]);
+    }
+
+    if (depth < 0 || depth > WIDTH * HEIGHT || bufferMB == 0) {
+        printf("Expected perft [-unique] [-buffer MB] <depth>\n");
+        return 1;
+    }
+
+    if (unique)
+        return countUnique(depth, bufferMB);
+
+    int threads = getThreadCount();
+    for (int ply = 1; ply <= depth; ply++) {
+        double start = getTime();
+        unsigned long long leaves = countLeaves(ply, threads);
+        double seconds = getTime() - start;
+        printf("Ply %d: %llu leaves, %.3f s, %.0f positions/s\n", ply, leaves, seconds, (seconds > 0) ? leaves / seconds : 0);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "Main.h"
+
+// the replies of the opponent in the order the search would try them, forced replies only if there are any
+static int orderReplies(Ponder* ponder, bitboard replies[WIDTH]) {
+    BoardState* board = &ponder->board;
+    bitboard moves = generateMoves(board);
+    bitboard nonLosingMoves = getNonLosingMove(board, moves);
+    char order[WIDTH];
+    Entry entry;
+
+    centerOrder(order);
+    int found = getBoardEntry(ponder->table, board, &entry);
+    int count = sortMoves(board, nonLosingMoves ? nonLosingMoves : moves, order, found ? &entry : NULL);
+
+    for (int i = 0; i < count; i++) {
+        replies[i] = moves & (MOVE_MASK << order[i]);
+    }
+    return count;
+}
+
+static void* ponderWorker(void* arg) {
+    Ponder* ponder = (Ponder*)arg;
+    BoardState* board = &ponder->board;
+    bitboard replies[WIDTH];
+
+    // nothing to solve if the opponent wins at once
+    bitboard moves = generateMoves(board);
+    if (computeWinningPosition(board->position, board->mask) & moves)
+        return NULL;
+
+    int count = orderReplies(ponder, replies);
+    for (int i = 0; i < count && !ponder->cancel; i++) {
+        BoardState child = *board;
+        makeMove(&child, replies[i]);
+        if (!generateMoves(&child))
+            continue;
+
+        SolveResult result;
+        solveCancellable(&child, ponder->table, ponder->weak, ponder->threads, &ponder->cancel, &result);
+        if (!result.complete)
+            break;
+
+        ponder->replies[ponder->solved] = replies[i];
+        ponder->results[ponder->solved] = result;
+        ponder->solved++;
+    }
+
+    return NULL;
+}
+
+// start solving the replies to the board (the opponent to move) in the background
+void startPonder(Ponder* ponder, BoardState* board, HashTable* table, int weak, int threads) {
+    ponder->board = *board;
+    ponder->table = table;
+    ponder->weak = weak;
+    ponder->threads = threads;
+    ponder->cancel = 0;
+    ponder->solved = 0;
+    ponder->running = pthread_create(&ponder->handle, NULL, ponderWorker, ponder) == 0;
+}
+
+// cancel the background solve and wait for it, the table and the complete results are kept
+void stopPonder(Ponder* ponder) {
+    if (!ponder->running)
+        return;
+
+    ponder->cancel = 1;
+    pthread_join(ponder->handle, NULL);
+    ponder->running = 0;
+}
+
+// the result of a stopped ponder for the board after the opponent's reply, returns 0 if it wasn't solved
+int ponderResult(Ponder* ponder, BoardState* board, SolveResult* result) {
+    for (int i = 0; i < ponder->solved; i++) {
+        BoardState child = ponder->board;
+        makeMove(&child, ponder->replies[i]);
+        if (child.position == board->position && child.mask == board->mask) {
+            *result = ponder->results[i];
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "Main.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define SERVER_LINE 256
+
+typedef struct {
+    Engine* engine;
+    FILE* in;
+    FILE* out;
+} Connection;
+
+// answer one request line, returns 0 when the connection should close
+static int handleRequest(Engine* engine, char* line, FILE* out) {
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (line[0] == '\0') {
+        fprintf(out, "error empty request\n");
+        return 1;
+    }
+
+    if (strcmp(line, "quit") == 0)
+        return 0;
+
+    if (strcmp(line, "clear") == 0) {
+        engineClear(engine);
+        fprintf(out, "ok\n");
+        return 1;
+    }
+
+    // the search statistics of every solve so far as one line of JSON
+    if (strcmp(line, "stats") == 0) {
+        SearchStats stats;
+        engineStats(engine, &stats);
+        writeStatsJson(out, &stats);
+        return 1;
+    }
+
+    // analyze <moves> scores every column, "-" for a full column
+    if (strncmp(line, "analyze ", 8) == 0) {
+        EngineAnalysis analysis;
+        int error = engineAnalyzeMoves(engine, line + 8, &analysis);
+        if (error != ENGINE_OK) {
+            fprintf(out, "error %s\n", engineError(error));
+            return 1;
+        }
+
+        for (int i = 0; i < ENGINE_COLUMNS; i++) {
+            if (analysis.scores[i] == ENGINE_NO_SCORE)
+                fprintf(out, "- ");
+            else
+                fprintf(out, "%d ", analysis.scores[i]);
+        }
+        fprintf(out, "%d %llu %.3f\n", analysis.move + 1, analysis.nodes, analysis.seconds * 1000);
+        return 1;
+    }
+
+    EngineResult result;
+    int error;
+    if (strncmp(line, "board ", 6) == 0) {
+        unsigned long long p1, p2;
+        int player;
+        if (sscanf(line + 6, "%lli %lli %d", &p1, &p2, &player) != 3) {
+            fprintf(out, "error expected board <p1> <p2> <player>\n");
+            return 1;
+        }
+        error = engineSolve(engine, p1, p2, player, &result);
+    }
+    else {
+        error = engineSolveMoves(engine, line, &result);
+    }
+
+    if (error != ENGINE_OK) {
+        fprintf(out, "error %s\n", engineError(error));
+        return 1;
+    }
+
+    // a search that ran out of time answers with the bounds it proved
+    if (result.complete)
+        fprintf(out, "%d", result.score);
+    else
+        fprintf(out, "%d:%d", result.lower, result.upper);
+    fprintf(out, " %d %llu %.3f%s\n", result.move + 1, result.nodes, result.seconds * 1000,
+            (result.book) ? " book" : (result.cached) ? " cache" : "");
+    return 1;
+}
+
+// answer the requests of a connection in order, a client can send several
+// requests without waiting and read the replies back one line each
+static void serveStream(Engine* engine, FILE* in, FILE* out) {
+    char line[SERVER_LINE];
+
+    while (fgets(line, sizeof(line), in)) {
+        if (!handleRequest(engine, line, out))
+            break;
+        fflush(out);
+    }
+}
+
+#ifndef _WIN32
+static void* connectionWorker(void* arg) {
+    Connection* connection = (Connection*)arg;
+    serveStream(connection->engine, connection->in, connection->out);
+    fclose(connection->in);
+    fclose(connection->out);
+    free(connection);
+    return NULL;
+}
+
+// accept clients on a UNIX socket, each connection is served by its own thread and they all share the engine
+static int serveSocket(Engine* engine, char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        printf("Error opening socket %s\n", path);
+        return 1;
+    }
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+
+    // a client hanging up before its reply only ends that connection
+    signal(SIGPIPE, SIG_IGN);
+
+    while (1) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        Connection* connection = malloc(sizeof(Connection));
+        connection->engine = engine;
+        connection->in = fdopen(client, "r");
+        connection->out = fdopen(dup(client), "w");
+
+        pthread_t handle;
+        pthread_create(&handle, NULL, connectionWorker, connection);
+        pthread_detach(handle);
+    }
+
+    return 0;
+}
+#endif
+
+// keep the solver running and answer requests from stdin or a UNIX socket, one line per request:
+//   <moves>                     solve the position after the moves, columns 1 to WIDTH as in the test files
+//   board <p1> <p2> <player>    solve a position given as bitboards with player 0 or 1 to move
+//   analyze <moves>             score every column, answered with the WIDTH scores, the best move, nodes and ms
+//   clear                       empty the table
+//   stats                       search statistics as JSON, collected in builds with SEARCH_STATS
+//   quit                        close the connection
+// every position is answered with "<score> <move> <nodes> <ms>", the score is "<lower>:<upper>" if the
+// time limit ran out, positions found in the book end with "book" and those found in the solve cache with "cache"
+// options: -socket <path>, -time <seconds per request>, -weak, -book <compiled book>, -cache <solve cache>
+int serve(int argc, char* argv[]) {
+    char* socketPath = NULL;
+    char* bookPath = NULL;
+    char* cachePath = NULL;
+    double timeLimit = 0;
+    int weak = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-socket") == 0 && i + 1 < argc)
+            socketPath = argv[++i];
+        else if (strcmp(argv[i], "-time") == 0 && i + 1 < argc)
+            timeLimit = atof(argv[++i]);
+        else if (strcmp(argv[i], "-weak") == 0)
+            weak = 1;
+        else if (strcmp(argv[i], "-book") == 0 && i + 1 < argc)
+            bookPath = argv[++i];
+        else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc)
+            cachePath = argv[++i];
+    }
+
+    Engine* engine = engineCreate(0, getThreadCount());
+    if (engine == NULL) {
+        printf("Error allocating the table\n");
+        return 1;
+    }
+    engineSetWeak(engine, weak);
+    engineSetTimeLimit(engine, timeLimit);
+
+    // errors go to stderr, stdout carries the replies
+    int error = (bookPath != NULL) ? engineSetBook(engine, bookPath) : ENGINE_OK;
+    if (error != ENGINE_OK) {
+        fprintf(stderr, "%s: %s\n", bookPath, engineError(error));
+        engineFree(engine);
+        return 1;
+    }
+
+    if (cachePath != NULL && engineSetCache(engine, cachePath) != ENGINE_OK) {
+        fprintf(stderr, "%s: %s\n", cachePath, engineError(ENGINE_CACHE_ERROR));
+        engineFree(engine);
+        return 1;
+    }
+
+    int result = 0;
+    if (socketPath != NULL) {
+#ifdef _WIN32
+        printf("Sockets are not supported on this platform, serving stdin\n");
+        serveStream(engine, stdin, stdout);
+#else
+        result = serveSocket(engine, socketPath);
+#endif
+    }
+    else {
+        serveStream(engine, stdin, stdout);
+    }
+
+    engineFree(engine);
+    return result;
+}
@@ -0,0 +1,37 @@
+#include "Main.h"
+
+// add every counter of stats to total
+void mergeStats(SearchStats* total, const SearchStats* stats) {
+    unsigned long long* to = (unsigned long long*)total;
+    const unsigned long long* from = (const unsigned long long*)stats;
+
+    for (size_t i = 0; i < sizeof(SearchStats) / sizeof(unsigned long long); i++) {
+        to[i] += from[i];
+    }
+}
+
+static void writeArray(FILE* file, const char* name, const unsigned long long* values, int count) {
+    fprintf(file, ", \"%s\": [", name);
+    for (int i = 0; i < count; i++) {
+        fprintf(file, (i > 0) ? ", %llu" : "%llu", values[i]);
+    }
+    fprintf(file, "]");
+}
+
+// write the statistics as one line of JSON, "enabled" is 0 in builds that don't collect them
+int writeStatsJson(FILE* file, const SearchStats* stats) {
+    const SearchStats* s = stats;
+    fprintf(file, "{\"enabled\": %d, \"solves\": %llu, \"iterations\": %llu, \"nodes\": %llu",
+            SEARCH_STATS, s->solves, s->iterations, s->nodes);
+    fprintf(file, ", \"probes\": %llu, \"hits\": %llu, \"hitRate\": %.4f, \"exactHits\": %llu",
+            s->probes, s->hits, (s->probes) ? (double)s->hits / s->probes : 0, s->exactHits);
+    fprintf(file, ", \"tableCutoffs\": %llu, \"parityCutoffs\": %llu", s->tableCutoffs, s->boundCutoffs - s->tableCutoffs);
+    fprintf(file, ", \"childProbes\": %llu, \"childHits\": %llu, \"childCutoffs\": %llu", s->childProbes, s->childHits, s->childCutoffs);
+    fprintf(file, ", \"storesEmpty\": %llu, \"storesUpdate\": %llu, \"storesReplace\": %llu, \"storesDropped\": %llu",
+            s->stores[STORE_EMPTY], s->stores[STORE_UPDATE], s->stores[STORE_REPLACE], s->stores[STORE_DROP]);
+    fprintf(file, ", \"allNodes\": %llu, \"forcedLosses\": %llu, \"prunedMoves\": %llu", s->allNodes, s->forcedLosses, s->prunedMoves);
+    writeArray(file, "betaCutoffs", s->betaCutoffs, WIDTH);
+    writeArray(file, "nodesByPly", s->nodesByPly, WIDTH * HEIGHT + 1);
+    fprintf(file, "}\n");
+    return ferror(file) != 0;
+}
@@ -0,0 +1,46 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include "Board.h"
+
+// Search statistics, collected only in builds with -DSEARCH_STATS=1 (make stats). Every search
+// thread counts into its own SearchStats and the threads are merged when the solve ends, without
+// SEARCH_STATS the counting macros expand to nothing, search threads and results carry no SearchStats
+// and the search is the same as without them
+#ifndef SEARCH_STATS
+#define SEARCH_STATS 0
+#endif
+
+#if SEARCH_STATS
+#define STAT_ADD(stats, field, n) ((stats)->field += (n))
+#define STAT_STORE(stats, store) ((stats)->stores[store]++)
+#else
+#define STAT_ADD(stats, field, n) ((void)0)
+#define STAT_STORE(stats, store) ((void)(store))
+#endif
+
+typedef struct {
+    unsigned long long solves;
+    unsigned long long iterations; // null window searches at the root
+    unsigned long long nodes;
+    unsigned long long nodesByPly[WIDTH * HEIGHT + 1]; // by the number of stones on the board
+    unsigned long long probes; // table probes of searched nodes
+    unsigned long long hits;
+    unsigned long long exactHits; // nodes answered by an exact entry
+    unsigned long long tableCutoffs; // nodes cut by the bounds of an entry
+    unsigned long long boundCutoffs; // nodes cut by the bounds of an entry or the parity of the empty cells
+    unsigned long long childProbes; // probes for enhanced transposition cutoffs
+    unsigned long long childHits;
+    unsigned long long childCutoffs;
+    unsigned long long stores[4]; // indexed by STORE_EMPTY, STORE_UPDATE, STORE_REPLACE and STORE_DROP
+    unsigned long long betaCutoffs[WIDTH]; // by the position in the move order of the move that failed high
+    unsigned long long allNodes; // nodes that searched every move without a cutoff
+    unsigned long long forcedLosses; // nodes without a move that doesn't lose at once
+    unsigned long long prunedMoves; // moves getNonLosingMove removed
+} SearchStats;
+
+void mergeStats(SearchStats* total, const SearchStats* stats);
+int writeStatsJson(FILE* file, const SearchStats* stats);
+
+#endif // STATS_H